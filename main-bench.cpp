@@ -0,0 +1,28 @@
+#include "tetrino-bench.hpp"
+
+#include <cstdlib>
+#include <new>
+
+// Count the heap allocations of the benchmarks.
+void *operator new(size_t size) {
+    bench_num_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = malloc(size ? size : 1)) return p;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+
+// Run the benchmarks and print their results as JSON. Input logs given as arguments are replayed
+// as an extra benchmark.
+int main(int argc, char **argv) {
+    std::vector<InputLog> logs;
+    for (int i = 1; i < argc; ++i) {
+        if (!read_input_log(argv[i], logs)) {
+            std::cerr << "Cannot read input log " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    print_bench_json(std::cout, run_benchmarks(logs));
+    return 0;
+}
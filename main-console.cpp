@@ -1,8 +1,40 @@
 #include "tetrino-console.hpp"
 
+#include <cstdlib>
+#include <cstring>
+
 int main(int argc, char **argv) {
     TetrisConsole game;
 
+    for (int i = 1; i < argc; i += 2) {
+        if (strcmp(argv[i], "--demo") == 0) {
+            game.play_demo();
+            i--;
+        } else if (i + 1 == argc) {
+            break;
+        } else if (strcmp(argv[i], "--record") == 0) {
+            if (!game.record(argv[i + 1])) {
+                std::cerr << "Cannot write " << argv[i + 1] << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            if (!game.record_stats(argv[i + 1])) {
+                std::cerr << "Cannot write " << argv[i + 1] << std::endl;
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--preview") == 0) {
+            int depth = atoi(argv[i + 1]);
+            if (depth < 1 || depth > Tetris::max_preview) {
+                std::cerr << "The preview shows 1 to " << Tetris::max_preview << " pieces"
+                          << std::endl;
+                return 1;
+            }
+            game.set_preview_depth(depth);
+        } else if (strcmp(argv[i], "--spin") == 0) {
+            game.set_spin(atoi(argv[i + 1]));
+        }
+    }
+
     while (game.tic()) {
         game.draw();
         game.present();
@@ -10,4 +42,4 @@ int main(int argc, char **argv) {
     }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,5 +1,8 @@
 #include "tetrino-sdl.hpp"
 
+#include <cstdlib>
+#include <cstring>
+
 int main(int arc, char **argv) {
 
     if (SDL_Init(SDL_INIT_VIDEO) < 0) {
@@ -14,6 +17,23 @@ int main(int arc, char **argv) {
 
     {
         auto game = TetrisSDL();
+        for (int i = 1; i + 1 < arc; i += 2) {
+            if (strcmp(argv[i], "--record") == 0 && !game.record(argv[i + 1])) {
+                std::cout << "Cannot write " << argv[i + 1] << std::endl;
+                exit(1);
+            } else if (strcmp(argv[i], "--stats") == 0 && !game.record_stats(argv[i + 1])) {
+                std::cout << "Cannot write " << argv[i + 1] << std::endl;
+                exit(1);
+            } else if (strcmp(argv[i], "--preview") == 0) {
+                int depth = atoi(argv[i + 1]);
+                if (depth < 1 || depth > Tetris::max_preview) {
+                    std::cout << "The preview shows 1 to " << Tetris::max_preview << " pieces"
+                              << std::endl;
+                    exit(1);
+                }
+                game.set_preview_depth(depth);
+            }
+        }
         while (game.tic()) {
             game.draw();
             game.present();
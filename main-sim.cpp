@@ -0,0 +1,90 @@
+#include "tetrino-batch.hpp"
+#include "tetrino-bot.hpp"
+#include "tetrino-replay.hpp"
+
+#include <cstdlib>
+#include <cstring>
+
+// Replay input logs as fast as possible and check that every game ends as recorded.
+int replay_logs(int num_paths, char **paths) {
+    std::vector<InputLog> games;
+    for (int i = 0; i < num_paths; ++i) {
+        if (!read_input_log(paths[i], games)) {
+            std::cerr << "Cannot read input log " << paths[i] << std::endl;
+            return 1;
+        }
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    size_t num_inputs = 0;
+    int num_mismatches = 0;
+    for (size_t g = 0; g < games.size(); ++g) {
+        num_inputs += games[g].inputs.size();
+        if (!replay(games[g])) {
+            std::cout << "game " << g << " (seed " << games[g].seed << ") does not match\n";
+            num_mismatches++;
+        }
+    }
+    double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::cout << "games:       " << games.size() << '\n'
+              << "mismatches:  " << num_mismatches << '\n'
+              << "inputs:      " << num_inputs << '\n'
+              << "wall time:   " << elapsed << " s\n"
+              << "games/s:     " << games.size() / elapsed << '\n';
+    return num_mismatches ? 1 : 0;
+}
+
+// Let the bot play games one after the other from `level`, each searched over all the threads of
+// the pool. A game stops at bot_max_time if it is not over by then.
+int play_bot(int num_games, unsigned int first_seed, ThreadPool &pool, int level) {
+    constexpr ssize_t bot_max_time = 60'000'000;
+    BotConfig config;
+    config.delay = Tetris::frame_period;
+    BeamSearchBot bot(config, LinearEvaluator{}, &pool);
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<GameReport> reports;
+    for (int g = 0; g < num_games; ++g) {
+        unsigned int seed = first_seed + g;
+        TetrisSim game(seed);
+        game.set_preview_depth(std::clamp(config.depth - 1, 1, Tetris::max_preview));
+        game.play(bot, level, bot_max_time);
+        reports.push_back({seed, game.get_score(), game.get_num_lines_cleared(),
+                           game.get_num_pieces(), game.get_game_time()});
+    }
+    double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    print_batch_report(std::cout, reports, elapsed, pool.size());
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "--replay") == 0) return replay_logs(argc - 2, argv + 2);
+    if (argc > 1 && strcmp(argv[1], "--bot") == 0) {
+        int num_games = (argc > 2) ? atoi(argv[2]) : 4;
+        unsigned int seed = (argc > 3) ? atoi(argv[3]) : 0;
+        ThreadPool pool((argc > 4) ? atoi(argv[4]) : std::thread::hardware_concurrency());
+        int level = (argc > 5) ? atoi(argv[5]) : 1;
+        if (level < 1 || level > Tetris::max_level) {
+            std::cerr << "Levels go from 1 to " << Tetris::max_level << std::endl;
+            return 1;
+        }
+        return play_bot(num_games, seed, pool, level);
+    }
+
+    int num_games = (argc > 1) ? atoi(argv[1]) : 1000;
+    unsigned int seed = (argc > 2) ? atoi(argv[2]) : 0;
+    ThreadPool pool((argc > 3) ? atoi(argv[3]) : std::thread::hardware_concurrency());
+
+    auto start = std::chrono::steady_clock::now();
+    auto reports =
+        run_batch(pool, seed, num_games, [](unsigned int seed) { return RandomInputs(seed); });
+    double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    print_batch_report(std::cout, reports, elapsed, pool.size());
+    return 0;
+}
@@ -0,0 +1,61 @@
+#ifndef __tetrino_batch_hpp__
+#define __tetrino_batch_hpp__
+
+#include "tetrino-pool.hpp"
+#include "tetrino-sim.hpp"
+
+#include <iostream>
+#include <vector>
+
+struct GameReport {
+    unsigned int seed;
+    int score;
+    int num_lines_cleared;
+    int num_pieces;
+    ssize_t game_time;
+};
+
+// Play `num_games` independent games, with seeds from `first_seed` on, spread over the threads
+// of the pool. `make_source(seed)` returns the input source of each game (see TetrisSim::play).
+template <class MakeSource>
+std::vector<GameReport> run_batch(ThreadPool &pool, unsigned int first_seed, size_t num_games,
+                                  MakeSource &&make_source, int level = 1,
+                                  ssize_t max_time = never) {
+    std::vector<GameReport> reports(num_games);
+    pool.parallel_for(num_games, [&](size_t g, int) {
+        unsigned int seed = first_seed + g;
+        TetrisSim game(seed);
+        game.play(make_source(seed), level, max_time);
+        reports[g] = {seed, game.get_score(), game.get_num_lines_cleared(),
+                      game.get_num_pieces(), game.get_game_time()};
+    });
+    return reports;
+}
+
+// Print aggregated statistics of a batch.
+inline void print_batch_report(std::ostream &os, const std::vector<GameReport> &reports,
+                               double wall_time, int num_threads) {
+    if (reports.empty()) return;
+    double n = reports.size();
+    double score = 0, lines = 0, pieces = 0, time = 0;
+    auto [min_score, max_score] = std::minmax_element(
+        begin(reports), end(reports), [](auto &a, auto &b) { return a.score < b.score; });
+    for (const auto &r : reports) {
+        score += r.score;
+        lines += r.num_lines_cleared;
+        pieces += r.num_pieces;
+        time += r.game_time * 1e-6;
+    }
+    os << "games:       " << reports.size() << '\n'
+       << "threads:     " << num_threads << '\n'
+       << "score:       " << score / n << " mean, " << min_score->score << " min, "
+       << max_score->score << " max\n"
+       << "lines:       " << lines / n << " mean\n"
+       << "pieces:      " << pieces / n << " mean\n"
+       << "game length: " << time / n << " s mean\n"
+       << "wall time:   " << wall_time << " s\n"
+       << "games/s:     " << n / wall_time << '\n'
+       << "pieces/s:    " << pieces / wall_time << '\n';
+}
+
+#endif // __tetrino_batch_hpp__
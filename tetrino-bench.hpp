@@ -0,0 +1,218 @@
+#ifndef __tetrino_bench_hpp__
+#define __tetrino_bench_hpp__
+
+#include "tetrino-bot.hpp"
+#include "tetrino-replay.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Number of heap allocations so far. The benchmark executable counts them by replacing the global
+// operator new (see main-bench.cpp); elsewhere it stays at zero.
+inline std::atomic<size_t> bench_num_allocations{0};
+
+// Keep the compiler from optimizing a value away.
+template <class T> inline void do_not_optimize(const T &value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct BenchResult {
+    std::string name;
+    size_t num_ops;
+    double ns_per_op;
+    double allocs_per_op;
+};
+
+// Call op(i) in batches of `batch` calls until `min_time` seconds have passed, and report the
+// fastest batch. The allocations are averaged over all the calls.
+template <class F>
+BenchResult measure(const std::string &name, F &&op, size_t batch = 4096, double min_time = 0.5) {
+    using clock = std::chrono::steady_clock;
+    double best = std::numeric_limits<double>::infinity();
+    size_t num_ops = 0;
+    size_t allocs = bench_num_allocations;
+    auto start = clock::now();
+    do {
+        auto t0 = clock::now();
+        for (size_t i = 0; i < batch; ++i) op(num_ops + i);
+        auto t1 = clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count() / batch);
+        num_ops += batch;
+    } while (std::chrono::duration<double>(clock::now() - start).count() < min_time);
+    double allocs_per_op = (double)(bench_num_allocations - allocs) / num_ops;
+    return {name, num_ops, best, allocs_per_op};
+}
+
+// Exposes the engine internals the kernels need, and builds the positions they run on.
+class BenchGame : public TetrisSim {
+  public:
+    using TetrisSim::TetrisSim;
+    using TetrisSim::try_rotate;
+
+    // Complete the n bottom rows and clear them. The score is reset so that it cannot overflow.
+    void clear_bottom_rows(int n) {
+        for (int y = matrix_height - n; y < matrix_height; ++y) matrix.set_row(y, Matrix::full_row);
+        clear_rows(0);
+        tally = 0;
+    }
+
+    void set_matrix(const Matrix &m) { matrix = m; }
+
+    // Matrices met in games with random inputs, stopped at different times.
+    static std::vector<Matrix> sample_matrices(unsigned int seed, int num_matrices) {
+        std::vector<Matrix> matrices;
+        for (int i = 0; i < num_matrices; ++i) {
+            BenchGame game(seed + i);
+            game.play(RandomInputs(seed + i), 1, (ssize_t)(i % 30 + 1) * 1'000'000);
+            matrices.push_back(game.matrix);
+        }
+        return matrices;
+    }
+};
+
+// Run the engine kernels on the positions of fixed seeds, then whole games: the random input
+// streams of fixed seeds and, if any, the recorded games of `logs`.
+inline std::vector<BenchResult> run_benchmarks(const std::vector<InputLog> &logs) {
+    using Matrix = Tetris::Matrix;
+    constexpr int num_matrices = 64;
+    auto matrices = BenchGame::sample_matrices(1, num_matrices);
+
+    // Every type and rotation of tetrimino, over a spread of positions.
+    std::vector<Tetrimino> blocks;
+    for (auto type : Tetrimino::all_types) {
+        for (int rot = 0; rot < 4; ++rot) {
+            for (int x = -1; x < Tetris::matrix_width - 1; ++x) {
+                Tetrimino block(type);
+                block.rotate(rot);
+                block.pos = {x, Tetris::matrix_height - Tetris::skyline - 2};
+                blocks.push_back(block);
+            }
+        }
+    }
+    auto block_at = [&](size_t i) -> const Tetrimino & { return blocks[i % blocks.size()]; };
+    auto matrix_at = [&](size_t i) -> const Matrix & {
+        return matrices[i / blocks.size() % num_matrices];
+    };
+
+    std::vector<Image<Tetris::matrix_width, Tetris::matrix_height>> images(num_matrices);
+    for (int m = 0; m < num_matrices; ++m) matrices[m].paste(images[m], {0, 0});
+
+    std::vector<BenchResult> results;
+
+    results.push_back(measure("Image::can_paste", [&](size_t i) {
+        const auto &block = block_at(i);
+        const auto &image = images[i / blocks.size() % num_matrices];
+        do_not_optimize(block.image().can_paste(image, block.pos));
+    }));
+
+    results.push_back(measure("Tetris::drop", [&](size_t i) {
+        const auto &block = block_at(i);
+        do_not_optimize(matrix_at(i).drop(block));
+    }));
+
+    results.push_back(measure("Tetris::drop + lock_delta", [&](size_t i) {
+        Tetrimino block = block_at(i);
+        const auto &matrix = matrix_at(i);
+        block.pos.y = matrix.drop(block);
+        int num_cleared;
+        do_not_optimize(matrix.lock_delta(block, num_cleared));
+    }));
+
+    results.push_back(measure("Tetris::try_rotate", [&](size_t i) {
+        Tetrimino block = block_at(i);
+        Tetris::MoveType type;
+        do_not_optimize(BenchGame::try_rotate(matrix_at(i), block, (i & 1) ? 1 : -1, type));
+    }));
+
+    {
+        // Clear one to four completed rows at the bottom of an empty matrix.
+        BenchGame game(1);
+        game.new_game(1);
+        results.push_back(measure("Tetris::clear_rows", [&](size_t i) {
+            game.clear_bottom_rows(i % 4 + 1);
+            do_not_optimize(game.get_matrix().rows);
+        }));
+    }
+
+    {
+        // The position hash of a game, over each matrix.
+        BenchGame game(1);
+        game.set_preview_depth(Tetris::max_preview);
+        game.new_game(1);
+        results.push_back(measure("Tetris::get_position_hash", [&](size_t i) {
+            game.set_matrix(matrices[i % num_matrices]);
+            do_not_optimize(game.get_position_hash());
+        }));
+    }
+
+    {
+        // One decision of the bot, on a single thread, for the first piece over each matrix.
+        BenchGame game(1);
+        game.set_preview_depth(2);
+        game.new_game(1);
+        BeamSearchBot bot;
+        std::vector<Tetris::Input::Value> moves;
+        results.push_back(measure(
+            "BeamSearchBot::decide",
+            [&](size_t i) {
+                game.set_matrix(matrices[i % num_matrices]);
+                bot.decide(game, moves);
+                do_not_optimize(moves.data());
+            },
+            16));
+    }
+
+    {
+        // Whole games, one per op, so that ops_per_s is the number of games per second.
+        constexpr unsigned int first_seed = 1000;
+        auto result = measure(
+            "Tetris::tic (random games)",
+            [&](size_t i) {
+                TetrisSim game(first_seed + i % 256);
+                game.play(RandomInputs(first_seed + i % 256));
+                do_not_optimize(game.get_board_hash());
+            },
+            16);
+        results.push_back(result);
+    }
+
+    {
+        // The same at 20G, where every fall event drops the block onto the surface.
+        constexpr unsigned int first_seed = 1000;
+        auto result = measure(
+            "Tetris::tic (random games, 20G)",
+            [&](size_t i) {
+                TetrisSim game(first_seed + i % 256);
+                game.set_gravity(20);
+                game.play(RandomInputs(first_seed + i % 256));
+                do_not_optimize(game.get_board_hash());
+            },
+            16);
+        results.push_back(result);
+    }
+
+    if (!logs.empty()) {
+        results.push_back(measure(
+            "Tetris::tic (recorded games)",
+            [&](size_t i) { do_not_optimize(replay(logs[i % logs.size()])); }, 4));
+    }
+
+    return results;
+}
+
+inline void print_bench_json(std::ostream &os, const std::vector<BenchResult> &results) {
+    os << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const auto &r = results[i];
+        os << "    {\"name\": \"" << r.name << "\", \"ops\": " << r.num_ops
+           << ", \"ns_per_op\": " << r.ns_per_op << ", \"ops_per_s\": " << 1e9 / r.ns_per_op
+           << ", \"allocs_per_op\": " << r.allocs_per_op << "}"
+           << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
+
+#endif // __tetrino_bench_hpp__
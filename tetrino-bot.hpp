@@ -0,0 +1,297 @@
+#ifndef __tetrino_bot_hpp__
+#define __tetrino_bot_hpp__
+
+#include "tetrino-pool.hpp"
+#include "tetrino-table.hpp"
+#include "tetrino.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <vector>
+
+// Scores a board reached by the search, higher being better, from the features of its stack and
+// the number of lines cleared on the way there.
+using Evaluator = std::function<double(const BoardFeatures &features, int num_lines_cleared)>;
+
+// A weighted sum of the features. The defaults are hand-tuned weights for height, lines, holes
+// and bumpiness, with a small penalty for row transitions.
+struct LinearEvaluator {
+    double aggregate_height = -0.510066;
+    double lines = 0.760666;
+    double holes = -0.35663;
+    double bumpiness = -0.184483;
+    double wells = 0;
+    double row_transitions = -0.05;
+
+    double operator()(const BoardFeatures &f, int num_lines_cleared) const {
+        return aggregate_height * f.aggregate_height + lines * num_lines_cleared +
+               holes * f.holes + bumpiness * f.bumpiness + wells * f.wells +
+               row_transitions * f.row_transitions;
+    }
+};
+
+struct BotConfig {
+    int beam_width = 16;
+    int depth = 3; // pieces placed by each line of play, the current one included
+    bool use_hold = true;
+    ssize_t delay = 0; // game time from the arrival of a piece to its moves, in us
+    int table_bits = 16; // log2 of the number of slots of the tables of boards
+};
+
+// Plays by beam search over the placements of the current piece and of the previewed ones, with
+// and without hold. Each level of the search expands every board of the beam with all the
+// placements of its next piece (see Tetris::PlacementSearch), scores them through
+// Tetris::lock_delta without building them, and keeps the `beam_width` best. The piece is then
+// played as the first move of the best board of the last level. The boards of a level are
+// expanded in parallel over the threads of the pool, if any. The scores of boards are cached by
+// hash across levels and decisions, in a table shared by the threads, and boards reached by
+// several lines of play are only kept once, from the best of them.
+class BeamSearchBot {
+  public:
+    using Input = Tetris::Input;
+
+    explicit BeamSearchBot(BotConfig config = {}, Evaluator evaluate = LinearEvaluator{},
+                           ThreadPool *pool = nullptr)
+        : config{config}, evaluate{std::move(evaluate)}, pool{pool},
+          candidates(pool ? pool->size() : 1), scores{config.table_bits},
+          seen{config.table_bits} {
+        assert(config.beam_width >= 1 && config.depth >= 1);
+        for (size_t t = 0; t < candidates.size(); ++t) {
+            searches.push_back(std::make_unique<Tetris::PlacementSearch>());
+        }
+    }
+
+    BeamSearchBot(const BeamSearchBot &) = delete;
+    BeamSearchBot &operator=(const BeamSearchBot &) = delete;
+
+    // An input source (see TetrisSim::play and TetrisThread::set_source). It plays each piece
+    // `delay` after it is called, all inputs at once, and starts a game `delay` after it first
+    // sees the welcome or game over screen.
+    bool operator()(const Tetris &game, std::queue<Input> &inputs) {
+        ssize_t time = game.get_game_time() + config.delay;
+        if (game.get_game_state() != Tetris::GameState::PLAY) {
+            // These screens take inputs as soon as they come, whatever their time.
+            if (pause_until == never) pause_until = time;
+            if (game.get_game_time() < pause_until) return true;
+            pause_until = never;
+            decision.assign(1, Input::Value::hard_drop);
+        } else {
+            // Decide on the game as it will be when the inputs are run.
+            Tetris ahead = game;
+            std::queue<Input> no_inputs;
+            ahead.tic(config.delay, no_inputs);
+            if (ahead.get_game_state() != Tetris::GameState::PLAY) return true;
+            decide(ahead, decision);
+        }
+        for (auto value : decision) {
+            inputs.push({value, Input::State::pressed, time});
+            inputs.push({value, Input::State::released, time});
+        }
+        return true;
+    }
+
+    // The inputs playing the current piece: a hold if any, moves, and a final hard drop.
+    void decide(const Tetris &game, std::vector<Input::Value> &moves) {
+        moves.assign(1, Input::Value::hard_drop);
+        pieces.assign(1, game.get_block().type);
+        for (int k = 0; k < std::min(config.depth - 1, game.get_preview_depth()); ++k) {
+            pieces.push_back(game.preview(k));
+        }
+
+        beam.assign(1, {game.get_matrix(), game.get_board_features(), pieces[0],
+                        game.get_held_block().type, 1, 0, 0, -1});
+        roots.clear();
+        int best_root = -1;
+        for (int level = 0; level < config.depth; ++level) {
+            if (!expand(game, level == 0)) break;
+            best_root = beam[0].root;
+        }
+        if (best_root < 0) return;
+
+        // Find the path of the first move of the best line of play.
+        const Root &root = roots[best_root];
+        auto &search = *searches[0];
+        search.run(game.get_matrix(), root_block(game, root.hold),
+                   root.hold ? Tetris::MoveType::NORMAL : game.get_last_move(),
+                   game.get_soft_drop_rows());
+        for (const auto &p : search.placements) {
+            if (p.pos == root.pos && p.rot == root.rot && p.type == root.type) {
+                search.path(p, moves);
+                if (root.hold) moves.insert(moves.begin(), Input::Value::hold);
+                return;
+            }
+        }
+        assert(false);
+    }
+
+  private:
+    struct Node {
+        Tetris::Matrix matrix;
+        BoardFeatures features;
+        Tetrimino::type_t current, held;
+        int next; // index in `pieces` of the piece after `current`
+        int num_lines_cleared;
+        double score;
+        int root; // index in `roots` of the first move leading here, -1 at the root
+    };
+
+    // A placement found while expanding a node, scored but not built.
+    struct Candidate {
+        double score;
+        int parent;
+        Tetrimino block;
+        bool hold;
+        int num_lines_cleared;
+        Tetris::MoveType type;
+    };
+
+    // First moves of the search.
+    struct Root {
+        bool hold;
+        Point pos;
+        int rot;
+        Tetris::MoveType type;
+    };
+
+    BotConfig config;
+    Evaluator evaluate;
+    ThreadPool *pool;
+    std::vector<std::unique_ptr<Tetris::PlacementSearch>> searches; // one per thread
+    std::vector<std::vector<Candidate>> candidates;                 // one per thread
+    std::vector<Candidate> merged;
+    std::vector<Tetrimino::type_t> pieces;
+    std::vector<Node> beam, next_beam;
+    std::vector<Root> roots;
+    // Score of each board and number of lines cleared, by their hash.
+    TranspositionTable<double> scores;
+    // Level at which each board was last kept, levels being numbered across decisions.
+    TranspositionTable<uint64_t> seen;
+    uint64_t level_number = 0;
+    std::vector<Input::Value> decision;
+    ssize_t pause_until = never;
+
+    // The block placed first, as the game has it or as it enters after a hold.
+    Tetrimino root_block(const Tetris &game, bool hold) const {
+        if (!hold) return game.get_block();
+        auto type = game.get_held_block().type;
+        Tetrimino block(type != Tetrimino::none ? type : pieces[1]);
+        block.pos = Tetris::spawn_position;
+        return block;
+    }
+
+    // Replace the beam with the best boards one piece further. Returns false if there are none,
+    // leaving the beam as it is. Lines of play which have run out of pieces stop there.
+    bool expand(const Tetris &game, bool is_root) {
+        auto run = [&](size_t i, int thread) {
+            const Node &node = beam[i];
+            if (node.current == Tetrimino::none) return;
+            auto &search = *searches[thread];
+            auto &found = candidates[thread];
+            auto add = [&](Tetrimino block, bool hold, Tetris::MoveType last_move) {
+                search.run(node.matrix, block, last_move, game.get_soft_drop_rows());
+                for (const auto &p : search.placements) {
+                    block.pos = p.pos;
+                    block.rotate(p.rot);
+                    // Locking this high ends the game (see Tetris::lock).
+                    if (block.pos.y < Tetris::matrix_height - Tetris::skyline) continue;
+                    int num_cleared;
+                    uint64_t key = node.matrix.lock_key(block, num_cleared);
+                    int lines = node.num_lines_cleared + num_cleared;
+                    // The score depends on the board and the lines cleared on the way.
+                    key ^= BagRandomizer::mix((lines + 1) * 0x9e3779b97f4a7c15);
+                    double score;
+                    if (!scores.find(key, score)) {
+                        auto delta = node.matrix.lock_delta(block, num_cleared);
+                        score = evaluate(node.features + delta, lines);
+                        scores.store(key, score);
+                    }
+                    found.push_back({score, (int)i, block, hold, lines, p.type});
+                }
+            };
+
+            auto spawn = [](Tetrimino::type_t type) {
+                Tetrimino block(type);
+                block.pos = Tetris::spawn_position;
+                return block;
+            };
+            if (is_root) {
+                add(game.get_block(), false, game.get_last_move());
+            } else {
+                add(spawn(node.current), false, Tetris::MoveType::NORMAL);
+            }
+            bool can_hold = config.use_hold && (!is_root || game.get_can_hold());
+            if (can_hold && node.held != node.current) {
+                auto type = (node.held != Tetrimino::none)
+                                ? node.held
+                                : (node.next < (int)pieces.size() ? pieces[node.next]
+                                                                  : Tetrimino::none);
+                if (type != Tetrimino::none) add(spawn(type), true, Tetris::MoveType::NORMAL);
+            }
+        };
+
+        for (auto &found : candidates) found.clear();
+        if (pool) {
+            pool->parallel_for(beam.size(), run);
+        } else {
+            for (size_t i = 0; i < beam.size(); ++i) run(i, 0);
+        }
+
+        merged.clear();
+        for (auto &found : candidates) merged.insert(merged.end(), found.begin(), found.end());
+        if (merged.empty()) return false;
+        auto better = [](const Candidate &a, const Candidate &b) { return a.score > b.score; };
+        std::sort(merged.begin(), merged.end(), better);
+
+        next_beam.clear();
+        level_number++;
+        for (size_t c = 0; c < merged.size() && (int)next_beam.size() < config.beam_width; ++c) {
+            const Candidate &cand = merged[c];
+            const Node &parent = beam[cand.parent];
+            Node node = parent;
+            node.matrix.place(cand.block);
+            node.matrix.clear_full_rows();
+            node.features = node.matrix.features();
+            node.num_lines_cleared = cand.num_lines_cleared;
+            node.score = cand.score;
+            if (!cand.hold) {
+                node.current = piece_at(node.next++);
+            } else if (parent.held != Tetrimino::none) {
+                node.held = parent.current;
+                node.current = piece_at(node.next++);
+            } else {
+                node.held = parent.current;
+                node.next++;
+                node.current = piece_at(node.next++);
+            }
+            uint64_t key = position_hash(node), level;
+            if (seen.find(key, level) && level == level_number) continue;
+            seen.store(key, level_number);
+            if (is_root) {
+                node.root = roots.size();
+                roots.push_back({cand.hold, cand.block.pos, cand.block.rot, cand.type});
+            }
+            next_beam.push_back(node);
+        }
+        std::swap(beam, next_beam);
+        return true;
+    }
+
+    // The position hash of the game of a node (see Tetris::get_position_hash), with its block at
+    // the spawn position and whether it can hold left out.
+    uint64_t position_hash(const Node &node) const {
+        uint64_t h = node.matrix.key ^ Tetris::piece_key(1, node.held) ^
+                     Tetris::piece_key(0, node.current, 0, Tetris::spawn_position);
+        for (int k = node.next; k < (int)pieces.size(); ++k) {
+            h ^= Tetris::piece_key(2 + k - node.next, pieces[k]);
+        }
+        return h;
+    }
+
+    Tetrimino::type_t piece_at(int k) const {
+        return (k < (int)pieces.size()) ? pieces[k] : Tetrimino::none;
+    }
+};
+
+#endif // __tetrino_bot_hpp__
@@ -1,14 +1,22 @@
 #ifndef __tetrino_cnosole_hpp__
 #define __tetrino_cnosole_hpp__
 
-#include "tetrino.hpp"
+#include "tetrino-bot.hpp"
+#include "tetrino-stats.hpp"
+#include "tetrino-thread.hpp"
 
 #include <algorithm>
 #include <array>
-#include <chrono>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <string_view>
 #include <thread>
 
+#include <poll.h>
 #include <signal.h>
 #include <string.h>
 #include <termios.h>
@@ -18,15 +26,12 @@ class VT100 {
   public:
     static std::string clear() { return "\e[2J"; }
     static std::string cursor_to_origin() { return "\e[H"; }
-    static std::string cursor_to(int r, int c) {
-        return "\e[" + std::to_string(r) + ";" + std::to_string(c) + "H";
-    }
-    static std::string color(int c) { return "\e[" + std::to_string(c) + "m"; }
-    static std::string reversed(bool on) { return on ? "\e[7m" : "\e[27m"; }
     static std::string cursor(bool on) { return std::string{"\e[?25"} + (on ? 'h' : 'l'); }
     static std::string reset() { return "\e[0m"; }
 
-    using time_t = std::chrono::steady_clock::time_point;
+    // Select Graphic Rendition sequences used when presenting frames.
+    static constexpr std::string_view sgr_default = "\e[39m";
+    static constexpr std::string_view sgr_reversed[2] = {"\e[27m", "\e[7m"};
 
     VT100() {
         // Configure TTY.
@@ -35,9 +40,6 @@ class VT100 {
         tty.c_lflag &= ~(ICANON | ECHO); // raw mode
         tty.c_cc[VMIN] = 0;              // min input char (non-blocking)
         tcsetattr(STDIN_FILENO, TCSANOW, &tty);
-
-        // Time reference.
-        time_origin = std::chrono::steady_clock::now();
     }
 
     ~VT100() {
@@ -45,30 +47,64 @@ class VT100 {
         std::cout << VT100::cursor(true) << std::flush;
     }
 
-    ssize_t now() const {
-        auto now = std::chrono::steady_clock::now();
-        return std::chrono::duration_cast<std::chrono::microseconds>(now - time_origin).count();
+  private:
+    struct termios original_tty;
+    struct termios tty;
+};
+
+// Terminal output built in a fixed buffer and sent with a single write(2).
+template <size_t N> class TerminalBuffer {
+  public:
+    void put(char c) {
+        assert(size < N);
+        data[size++] = c;
     }
 
-    int nextc() {
-        if (pos >= count) {
-            count = read(STDIN_FILENO, buffer.data(), buffer.size());
-            pos = 0;
-        }
-        if (pos >= count) {
-            return EOF;
+    void put(std::string_view text) {
+        assert(size + text.size() <= N);
+        std::copy(begin(text), end(text), begin(data) + size);
+        size += text.size();
+    }
+
+    void put(int n) {
+        char digits[12];
+        int k = 0;
+        do {
+            digits[k++] = '0' + n % 10;
+            n /= 10;
+        } while (n > 0);
+        while (k > 0) put(digits[--k]);
+    }
+
+    void cursor_to(int r, int c) {
+        put("\e[");
+        put(r);
+        put(';');
+        put(c);
+        put('H');
+    }
+
+    // Move the cursor by |n| cells in the direction of a CUU, CUD, CUF or CUB sequence.
+    void cursor_move(int n, char direction) {
+        put("\e[");
+        put(std::abs(n));
+        put(direction);
+    }
+
+    void flush() {
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = write(STDOUT_FILENO, data.data() + done, size - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break;
+            done += n;
         }
-        return buffer[pos++];
+        size = 0;
     }
 
   private:
-    struct termios original_tty;
-    struct termios tty;
-    time_t time_origin;
-
-    std::array<char, 32> buffer;
-    int pos;
-    int count;
+    std::array<char, N> data;
+    size_t size = 0;
 };
 
 struct Box {
@@ -81,20 +117,35 @@ class TetrisConsole : public Tetris {
     static constexpr int intro_width = 36;
     static constexpr int intro_height = 15;
     static constexpr int xscale = 2;
+    // How long the demo bot waits before playing each piece, in us.
+    static constexpr ssize_t demo_delay = 200'000;
 
     static constexpr Box held_box{1, 3, Tetrimino::size *xscale + 2, Tetrimino::size + 2};
     static constexpr Box field_box{held_box.x + held_box.width + 7, held_box.y,
                                    matrix_width *xscale + 2, skyline + 1};
     static constexpr Box next_box{field_box.x + field_box.width + 2, held_box.y, held_box.width,
                                   held_box.height};
-    static constexpr Box tally_box{next_box.x, next_box.y + next_box.height + 1, 10};
+    // Widest line of the tally: the longest score event, back to back, with 5-digit points.
+    static constexpr int tally_width = 28;
+    static constexpr Box tally_box{next_box.x, next_box.y + next_box.height + 1, tally_width};
     static constexpr Box info_box{held_box.x, held_box.y + held_box.height + 1, held_box.width + 4};
-
-    static constexpr int screen_width = tally_box.x + tally_box.width;
+    // The pieces after the next one, 3 rows each; the box is as tall as the preview depth needs.
+    // It stands clear of the tally, which runs below the next piece.
+    static constexpr int queue_skip = 3;
+    static constexpr Box queue_box{tally_box.x + tally_box.width, next_box.y, next_box.width,
+                                   (max_preview - 1) * queue_skip + 1};
+
+    static constexpr int screen_width = queue_box.x + queue_box.width;
+
+    // Parts of the screen drawn on their own. The field area goes up to the top of the screen, as
+    // the block and its ghost may stick out above the skyline.
+    static constexpr Box score_area{tally_box.x, tally_box.y, tally_box.width, 7};
+    static constexpr Box info_area{info_box.x, info_box.y, info_box.width, 2};
     static constexpr int screen_height = field_box.y + field_box.height;
 
     static constexpr Box intro_box{(screen_width - intro_width) / 2,
                                    (screen_height - intro_height) / 2, intro_width, intro_height};
+    static constexpr Box field_area{field_box.x, 0, field_box.width, screen_height};
 
     enum Tiles {
         border_v = 512,
@@ -105,106 +156,203 @@ class TetrisConsole : public Tetris {
         border_br,
     };
 
-    TetrisConsole(unsigned int seed = 0) : Tetris(seed) {
-        std::cout << VT100::clear() << VT100::cursor_to_origin() << VT100::cursor(false)
-                  << std::flush;
-        last_frame_time = console.now();
-        last_sync_time = never;
+    // How a tile is printed. Tiles without a text are printed as the ASCII character they hold.
+    struct Glyph {
+        std::string_view color;
+        bool reversed;
+        std::string_view text;
+    };
+
+    // We use reversed space to draw the tetriminos as some console fonts implement the block
+    // character incorrectly.
+    static constexpr Glyph tetrimino_glyphs[] = {
+        {"\e[96m", true, " "}, // I
+        {"\e[91m", true, " "}, // L
+        {"\e[93m", true, " "}, // O
+        {"\e[95m", true, " "}, // T
+        {"\e[94m", true, " "}, // J
+        {"\e[31m", true, " "}, // Z
+        {"\e[92m", true, " "}, // S
+        {"\e[97m", true, " "}, // G
+    };
+    static constexpr Glyph border_glyphs[] = {
+        {VT100::sgr_default, false, "│"}, {VT100::sgr_default, false, "─"},
+        {VT100::sgr_default, false, "╭"}, {VT100::sgr_default, false, "╮"},
+        {VT100::sgr_default, false, "╰"}, {VT100::sgr_default, false, "╯"},
+    };
+    static constexpr Glyph text_glyph{VT100::sgr_default, false, {}};
+
+    static const Glyph &get_glyph(int tile) {
+        if (Tetrimino::I <= tile && tile <= Tetrimino::G) {
+            return tetrimino_glyphs[tile - Tetrimino::I];
+        }
+        if (border_v <= tile && tile <= border_br) return border_glyphs[tile - border_v];
+        return text_glyph;
+    }
+
+    // Worst case of a frame: the terminal is reset, then every cell moves the cursor and changes
+    // colour.
+    static constexpr size_t max_frame_bytes = 32 + screen_height * screen_width * (16 + 2 * 5 + 3);
+
+    TetrisConsole(unsigned int seed = 0) : Tetris(seed), simulation(seed) {
+        reset_terminal();
+        out.flush();
+
+        [[maybe_unused]] int ok = pipe(wake_pipe);
+        assert(ok == 0);
+        input_thread = std::thread([this] { read_inputs(); });
     }
 
-    ~TetrisConsole() { std::cout << VT100::cursor(true) << std::flush; }
+    ~TetrisConsole() {
+        [[maybe_unused]] ssize_t n = write(wake_pipe[1], "", 1);
+        input_thread.join();
+        close(wake_pipe[0]);
+        close(wake_pipe[1]);
+        dump_stats();
+        std::cout << VT100::cursor(true) << std::flush;
+    }
 
     const Image<screen_width, screen_height> &get_screen() const { return screen; }
 
     bool tic() {
-        ssize_t now = console.now();
-        constexpr ssize_t two_frames = (ssize_t)(2 * 1'000'000) / 60;
-        ssize_t elapsed = std::min(now - last_frame_time, two_frames);
-        last_frame_time = now;
-
-        // Read input buffer
-        ssize_t input_frame = current_frame() + 1;
-        Tetris::Input::Value command;
-        int c;
-        while ((c = console.nextc()) != EOF) {
-            switch (c) {
-            case '\e':
-                if ((c = console.nextc()) == '[') {
-                    switch (c = console.nextc()) {
-                    case 'D': command = Tetris::Input::Value::move_left; break;
-                    case 'C': command = Tetris::Input::Value::move_right; break;
-                    case 'B': command = Tetris::Input::Value::soft_drop; break;
-                    default: continue;
-                    }
-                } else {
-                    continue;
-                }
-                break;
-            case 'z': command = Tetris::Input::Value::rotate_left; break;
-            case 'x': command = Tetris::Input::Value::rotate_right; break;
-            case ' ': command = Tetris::Input::Value::hard_drop; break;
-            case 'q': command = Tetris::Input::Value::quit; break;
-            case 'c': command = Tetris::Input::Value::hold; break;
-            case 'r': old_screen.clear(0); continue; // redraw
-            default: continue;
-            }
-            inputs.push({command, Tetris::Input::State::pressed, input_frame});
-            inputs.push({command, Tetris::Input::State::released, input_frame});
+        int64_t start = FrameStats::now();
+        stats.begin_frame(start);
+        if (!simulation.is_started()) simulation.start();
+
+        if (redraw_requested.exchange(false)) {
+            // The terminal may have been disturbed in any way: start it over and print every cell.
+            reset_terminal();
+            old_screen.clear(0);
         }
+        if (stats_requested.exchange(false)) dump_stats();
+
+        // Show the latest state of the game.
+        if (simulation.update()) {
+            const auto &snapshot = simulation.snapshot();
+            load_state(snapshot.state);
+            alive = snapshot.alive;
+            stats.set_num_events(snapshot.num_events);
+            stats.set_num_missed_tics(snapshot.num_missed_tics);
+        }
+        stats.end_phase(FrameStats::TIC, start);
+        return alive;
+    }
+
+    // Record the games played to an input log.
+    bool record(const std::string &path) { return simulation.record(path); }
+
+    // The simulated game previews as many pieces as are shown, for the demo bot to see them.
+    void set_preview_depth(int depth) {
+        Tetris::set_preview_depth(depth);
+        simulation.set_preview_depth(depth);
+    }
+
+    // Attract mode: the game plays itself with a BeamSearchBot searching on `num_threads`
+    // threads, and the keyboard only quits. Call before the first tic().
+    void play_demo(int num_threads = std::thread::hardware_concurrency()) {
+        demo = true;
+        bot_pool = std::make_unique<ThreadPool>(num_threads);
+        BotConfig config;
+        config.delay = demo_delay;
+        bot = std::make_unique<BeamSearchBot>(config, LinearEvaluator{}, bot_pool.get());
+        simulation.set_source(
+            [this](const Tetris &game, std::queue<Input> &inputs) { return (*bot)(game, inputs); });
+    }
 
-        return Tetris::tic(elapsed, inputs);
+    // Append frame statistics to a file on exit and whenever 's' is pressed.
+    bool record_stats(const std::string &path) {
+        stats_file.open(path, std::ios::app);
+        return stats_file.is_open();
     }
 
+    void dump_stats() {
+        if (!stats_file.is_open()) return;
+        stats.print(stats_file);
+        stats_file << std::endl;
+    }
+
+    // Sleep until the next frame is due.
     void throttle() {
-        ssize_t now = console.now();
-        constexpr ssize_t one_frame = (ssize_t)(1'000'000) / 60;
-        ssize_t idle = std::max(now - (last_sync_time + one_frame), (ssize_t)0);
-        last_sync_time = now;
-        std::this_thread::sleep_for(std::chrono::microseconds(idle));
+        int64_t start = FrameStats::now();
+        if (!pacer.wait()) stats.record_missed_deadline();
+        stats.end_phase(FrameStats::THROTTLE, start);
     }
 
-    void draw() {
-        screen.clear();
+    // Busy-wait the last `spin` us before each frame rather than sleep, for steadier frames at the
+    // cost of CPU time.
+    void set_spin(ssize_t spin) { pacer.set_spin(spin * 1'000); }
 
-        draw_box(field_box, true);
-        draw_box(held_box);
-        draw_box(next_box);
-        draw_text("Next", next_box.pos() + Point{3, next_box.height - 1});
-        draw_text("Held", held_box.pos() + Point{3, held_box.height - 1});
-        for (int i = 0; i < skyline; ++i) {
-            draw_text(std::to_string(i + 1), field_box.pos() + Point{-3, field_box.height - 2 - i},
-                      2);
+    // Draw the parts of the screen whose content changed since the last call. The borders, labels
+    // and row numbers are drawn once in a background layer, and each part starts from it.
+    void draw() {
+        int64_t start = FrameStats::now();
+        View view = get_view();
+        if (has_drawn && view == shown) {
+            stats.end_phase(FrameStats::DRAW, start);
+            return;
         }
 
-        draw_text(std::string{"Score "} + std::to_string(tally), tally_box.pos(), tally_box.width);
+        bool all = !has_drawn || view.game_state != shown.game_state ||
+                   view.preview_depth != shown.preview_depth || game_state != GameState::PLAY;
+        if (all) {
+            draw_background();
+            screen = background;
+        }
 
-        for (int i = 0; i < 5; ++i) {
-            int m = messages.size() - i - 1;
-            if (m < 0) break;
-            draw_text(messages[m], tally_box.pos() + shift_down * (2 + i), tally_box.width);
+        if (all || view.tally != shown.tally || view.num_score_events != shown.num_score_events) {
+            restore(score_area);
+            draw_text(std::string{"Score "} + std::to_string(tally), tally_box.pos(),
+                      tally_box.width);
+            for (int i = 0; i < 5; ++i) {
+                if (i >= get_num_score_events()) break;
+                draw_text(get_score_event(i).text(), tally_box.pos() + shift_down * (2 + i),
+                          tally_box.width);
+            }
         }
 
-        draw_text(std::string{"Level "} + std::to_string(level),
-                  info_box.pos() + shift_down * info_box.height, info_box.width);
+        if (all || view.level != shown.level ||
+            view.num_lines_cleared != shown.num_lines_cleared) {
+            restore(info_area);
+            draw_text(std::string{"Level "} + std::to_string(level),
+                      info_box.pos() + shift_down * info_box.height, info_box.width);
+            draw_text(std::string{"Cleared "} + std::to_string(num_lines_cleared),
+                      info_box.pos() + shift_down * (info_box.height + 1), info_box.width);
+        }
 
-        draw_text(std::string{"Cleared "} + std::to_string(num_lines_cleared),
-                  info_box.pos() + shift_down * (info_box.height + 1), info_box.width);
+        if (all || view.game_seed != shown.game_seed || view.num_pieces != shown.num_pieces ||
+            view.block != shown.block || view.ghost_block != shown.ghost_block) {
+            restore(field_area);
+            int ycrop = matrix_height - skyline;
+            matrix.paste(screen, field_box.pos() + shift_right, xscale, ycrop);
+            if (ghost_block.type != Tetrimino::none) {
+                ghost_block.image().paste(screen,
+                                          field_box.pos() + Point{ghost_block.pos.x * xscale + 1,
+                                                                  ghost_block.pos.y - ycrop},
+                                          xscale);
+            }
+            int cr = std::max(ycrop - 1 - block.pos.y, 0);
+            block.image().paste(
+                screen, field_box.pos() + Point{1 + block.pos.x * xscale, block.pos.y + cr - ycrop},
+                xscale, cr);
+        }
 
-        int ycrop = matrix_height - skyline;
-        matrix.paste(screen, field_box.pos() + shift_right, xscale, ycrop);
-        if (ghost_block.type != Tetrimino::none) {
-            ghost_block.paste(screen,
-                              field_box.pos() +
-                                  Point{ghost_block.pos.x * xscale + 1, ghost_block.pos.y - ycrop},
-                              xscale);
+        if (all || view.num_sampled != shown.num_sampled) {
+            restore(next_box);
+            restore(queue_box);
+            Tetrimino(preview(0)).image().paste(screen, next_box.pos() + Point{1, 1}, xscale);
+            for (int k = 1; k < preview_depth; ++k) {
+                Tetrimino piece(preview(k));
+                piece.image().paste(screen,
+                                    queue_box.pos() + Point{1, 1 + (k - 1) * queue_skip}, xscale,
+                                    piece.bounds().top);
+            }
         }
-        int cr = std::max(ycrop - 1 - block.pos.y, 0);
-        block.paste(screen,
-                    field_box.pos() + Point{1 + block.pos.x * xscale, block.pos.y + cr - ycrop},
-                    xscale, cr);
-        next_block.paste(screen, next_box.pos() + Point{1, 1}, xscale);
-        if (held_block.type != Tetrimino::none) {
-            held_block.paste(screen, held_box.pos() + Point{1, 1}, xscale);
+
+        if (all || view.held_block != shown.held_block) {
+            restore(held_box);
+            if (held_block.type != Tetrimino::none) {
+                held_block.image().paste(screen, held_box.pos() + Point{1, 1}, xscale);
+            }
         }
 
         if (game_state == GameState::GAME_OVER || game_state == GameState::WELCOME) {
@@ -220,86 +368,264 @@ class TetrisConsole : public Tetris {
                                                         "space: hard drop\n"
                                                         "q:     quit"
                                                       : "Game Over";
+            if (demo && game_state == GameState::WELCOME) msg = "Demo\n\nq:     quit";
 
             int num_lines = std::count(msg, msg + strlen(msg), '\n') + 1;
 
             draw_text(msg, intro_box.pos() + Point{4, (intro_box.height - num_lines) / 2});
         }
+
+        shown = view;
+        has_drawn = true;
+        stats.end_phase(FrameStats::DRAW, start);
     }
 
+    // Print the cells that changed since the last frame. The cursor reaches each run of changed
+    // cells by whichever is shortest: an absolute move, a relative move, or printing again the
+    // unchanged cells in between.
     void present() {
+        int64_t start = FrameStats::now();
         for (int y = 0; y < screen.height; y++) {
             auto row = screen[y];
             auto old_row = old_screen[y];
-            auto same = equal(begin(row), end(row), begin(old_row));
-            if (same) continue;
-            copy(begin(row), end(row), begin(old_row));
-            if (cursor_y != y) {
-                std::cout << VT100::cursor_to(y + 1, 1);
-                cursor_y = y;
-            }
-            std::cout << VT100::color(39) << VT100::reversed(false);
-            int current_color = 39; // default
-            bool current_reversed = false;
-            for (auto tile : row) {
-                int color;
-                int reversed;
-                std::string glyph;
-#undef CASE
-#define CASE(T, C, R, G)                                                                           \
-    case T:                                                                                        \
-        color = C;                                                                                 \
-        glyph = G;                                                                                 \
-        reversed = R;                                                                              \
-        break;
-                switch (tile) {
-                    // We use reversed space to draw the tetriminos as some
-                    // console fonts implement the block character
-                    // incorrectly
-                    CASE(Tetrimino::I, 96, true, " "); 
-                    CASE(Tetrimino::J, 94, true, " ");
-                    CASE(Tetrimino::L, 91, true, " ");
-                    CASE(Tetrimino::O, 93, true, " ");
-                    CASE(Tetrimino::S, 92, true, " ");
-                    CASE(Tetrimino::T, 95, true, " ");
-                    CASE(Tetrimino::Z, 31, true, " ");
-                    CASE(Tetrimino::G, 97, true, " ");
-                    CASE(border_v, 39, false, "│");
-                    CASE(border_h, 39, false, "─");
-                    CASE(border_tl, 39, false, "╭");
-                    CASE(border_tr, 39, false, "╮");
-                    CASE(border_bl, 39, false, "╰");
-                    CASE(border_br, 39, false, "╯");
-                default:
-                    color = 39;
-                    reversed = false;
-                    glyph = (char)tile;
-                    break;
-                }
-                if (color != current_color) {
-                    std::cout << VT100::color(color);
-                    current_color = color;
-                }
-                if (reversed != current_reversed) {
-                    std::cout << VT100::reversed(reversed);
-                    current_reversed = reversed;
-                }
-                std::cout << glyph;
+            for (int x = 0; x < screen.width; ++x) {
+                if (row[x] == old_row[x]) continue;
+                move_cursor({x, y});
+                put_tile(row[x]);
+                old_row[x] = row[x];
             }
-            std::cout << '\n';
-            cursor_y++;
         }
-        std::cout << std::flush;
+        out.flush();
+        stats.end_phase(FrameStats::PRESENT, start);
     }
 
   protected:
+    // What the screen shows. Parts of it are drawn again when the fields they depend on change.
+    struct View {
+        GameState game_state;
+        unsigned int game_seed;
+        int num_pieces; // the matrix only changes when a piece locks
+        Tetrimino block;
+        Tetrimino ghost_block;
+        Tetrimino held_block;
+        uint64_t num_sampled;
+        int preview_depth;
+        int tally;
+        unsigned int num_score_events;
+        int level;
+        int num_lines_cleared;
+
+        bool operator==(const View &) const = default;
+    };
+
     VT100 console;
-    std::queue<Tetris::Input> inputs;
+    // The bot plays on the simulation thread, which must stop before they go.
+    std::unique_ptr<ThreadPool> bot_pool;
+    std::unique_ptr<BeamSearchBot> bot;
+    std::atomic<bool> demo{false};
+    TetrisThread simulation;
+    std::thread input_thread;
+    int wake_pipe[2];
+    std::atomic<bool> redraw_requested{false};
+    std::atomic<bool> stats_requested{false};
     Image<screen_width, screen_height> screen;
+    Image<screen_width, screen_height> background;
+    View shown;
+    bool has_drawn = false;
     Image<screen_width, screen_height> old_screen;
-    int cursor_y;
-    ssize_t last_frame_time;
-    ssize_t last_sync_time;
+    TerminalBuffer<max_frame_bytes> out;
+    // What the terminal is known to be at: cursor position (0-based) and graphic rendition. An
+    // empty colour or a negative reversed flag stands for unknown.
+    Point cursor;
+    bool cursor_known;
+    std::string_view current_color;
+    int current_reversed;
+    FramePacer pacer{Tetris::frame_period * 1'000};
+    FrameStats stats;
+    std::ofstream stats_file;
+
+    // Runs on input_thread: wait for key presses, time them and pass them on to the simulation,
+    // until anything is written to wake_pipe. Escape sequences may span reads.
+    void read_inputs() {
+        enum { TEXT, ESCAPE, CSI } parse = TEXT;
+        std::array<char, 32> buffer;
+        pollfd fds[2] = {{STDIN_FILENO, POLLIN, 0}, {wake_pipe[0], POLLIN, 0}};
+        while (true) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) continue;
+                return;
+            }
+            if (fds[1].revents) return;
+            ssize_t time = TetrisThread::now();
+            ssize_t count = read(STDIN_FILENO, buffer.data(), buffer.size());
+            if (count < 0 && (errno == EINTR || errno == EAGAIN)) continue;
+            if (count <= 0) return;
+
+            for (ssize_t i = 0; i < count; ++i) {
+                Tetris::Input::Value command;
+                char c = buffer[i];
+                if (parse == ESCAPE) {
+                    parse = (c == '[') ? CSI : TEXT;
+                    continue;
+                } else if (parse == CSI) {
+                    parse = TEXT;
+                    switch (c) {
+                    case 'D': command = Tetris::Input::Value::move_left; break;
+                    case 'C': command = Tetris::Input::Value::move_right; break;
+                    case 'B': command = Tetris::Input::Value::soft_drop; break;
+                    default: continue;
+                    }
+                } else {
+                    switch (c) {
+                    case '\e': parse = ESCAPE; continue;
+                    case 'z': command = Tetris::Input::Value::rotate_left; break;
+                    case 'x': command = Tetris::Input::Value::rotate_right; break;
+                    case ' ': command = Tetris::Input::Value::hard_drop; break;
+                    case 'q': command = Tetris::Input::Value::quit; break;
+                    case 'c': command = Tetris::Input::Value::hold; break;
+                    case 'r': redraw_requested = true; continue;
+                    case 's': stats_requested = true; continue;
+                    default: continue;
+                    }
+                }
+                if (demo && command != Tetris::Input::Value::quit) continue;
+                simulation.push({command, Tetris::Input::State::pressed, time});
+                simulation.push({command, Tetris::Input::State::released, time});
+            }
+        }
+    }
+
+    View get_view() const {
+        return {game_state, game_seed,     num_pieces, block,            ghost_block, held_block,
+                num_sampled, preview_depth, tally,      num_score_events, level,
+                num_lines_cleared};
+    }
+
+    // The parts of the screen which do not change during a game.
+    void draw_background() {
+        screen.clear();
+        draw_box(field_box, true);
+        draw_box(held_box);
+        draw_box(next_box);
+        if (preview_depth > 1) {
+            draw_box({queue_box.x, queue_box.y, queue_box.width,
+                      (preview_depth - 1) * queue_skip + 1});
+        }
+        draw_text("Next", next_box.pos() + Point{3, next_box.height - 1});
+        draw_text("Held", held_box.pos() + Point{3, held_box.height - 1});
+        for (int i = 0; i < skyline; ++i) {
+            draw_text(std::to_string(i + 1), field_box.pos() + Point{-3, field_box.height - 2 - i},
+                      2);
+        }
+        background = screen;
+    }
+
+    // Clear the terminal, home the cursor and reset the graphic rendition, which is then all that
+    // is known of the terminal.
+    void reset_terminal() {
+        out.put(VT100::reset());
+        out.put(VT100::clear());
+        out.put(VT100::cursor_to_origin());
+        out.put(VT100::cursor(false));
+        cursor = {0, 0};
+        cursor_known = true;
+        current_color = {};
+        current_reversed = -1;
+    }
+
+    // Reset a part of the screen to the background.
+    void restore(const Box &box) {
+        for (int y = box.y; y < box.y + box.height; ++y) {
+            auto from = background[y].subspan(box.x, box.width);
+            std::copy(begin(from), end(from), begin(screen[y]) + box.x);
+        }
+    }
+
+    static int num_digits(int n) { return n < 10 ? 1 : 1 + num_digits(n / 10); }
+
+    // Bytes needed to print a tile, and update the graphic rendition to it.
+    int tile_cost(int tile, std::string_view &color, int &reversed) const {
+        const Glyph &glyph = get_glyph(tile);
+        int cost = glyph.text.empty() ? 1 : glyph.text.size();
+        if (glyph.color != color) {
+            cost += glyph.color.size();
+            color = glyph.color;
+        }
+        if (glyph.reversed != reversed) {
+            cost += VT100::sgr_reversed[glyph.reversed].size();
+            reversed = glyph.reversed;
+        }
+        return cost;
+    }
+
+    void put_tile(int tile) {
+        const Glyph &glyph = get_glyph(tile);
+        if (glyph.color != current_color) {
+            out.put(glyph.color);
+            current_color = glyph.color;
+        }
+        if (glyph.reversed != current_reversed) {
+            out.put(VT100::sgr_reversed[glyph.reversed]);
+            current_reversed = glyph.reversed;
+        }
+        if (glyph.text.empty()) {
+            out.put((char)tile);
+        } else {
+            out.put(glyph.text);
+        }
+        // Past the last column, where the cursor goes depends on the width of the terminal.
+        cursor.x++;
+        if (cursor.x >= screen.width) cursor_known = false;
+    }
+
+    void move_cursor(Point p) {
+        if (cursor_known && cursor.x == p.x && cursor.y == p.y) return;
+
+        enum { ABSOLUTE, RELATIVE, REPRINT } how = ABSOLUTE;
+        int best = 4 + num_digits(p.y + 1) + num_digits(p.x + 1); // \e[{y};{x}H
+
+        // Relative moves: up or down, then left or right or back to the first column.
+        auto step = [](int n) { return n == 0 ? 0 : 3 + num_digits(std::abs(n)); }; // \e[{n}X
+        bool carriage_return = false;
+        if (cursor_known) {
+            int dx = step(p.x - cursor.x);
+            int cr = 1 + step(p.x);
+            carriage_return = cr < dx;
+            int cost = step(p.y - cursor.y) + std::min(dx, cr);
+            if (cost < best) {
+                best = cost;
+                how = RELATIVE;
+            }
+        }
+
+        // Printing the cells up to p again, which are unchanged.
+        if (cursor_known && cursor.y == p.y && cursor.x < p.x) {
+            auto color = current_color;
+            int reversed = current_reversed;
+            int cost = 0;
+            for (int x = cursor.x; x < p.x && cost < best; ++x) {
+                cost += tile_cost(screen[{x, p.y}], color, reversed);
+            }
+            if (cost < best) how = REPRINT;
+        }
+
+        switch (how) {
+        case ABSOLUTE: out.cursor_to(p.y + 1, p.x + 1); break;
+        case RELATIVE:
+            if (p.y != cursor.y) out.cursor_move(p.y - cursor.y, p.y > cursor.y ? 'B' : 'A');
+            if (carriage_return) {
+                out.put('\r');
+                cursor.x = 0;
+            }
+            if (p.x != cursor.x) out.cursor_move(p.x - cursor.x, p.x > cursor.x ? 'C' : 'D');
+            break;
+        case REPRINT:
+            while (cursor.x < p.x) put_tile(screen[{cursor.x, p.y}]);
+            break;
+        }
+        cursor = p;
+        cursor_known = true;
+    }
 
     void draw_box(const Box &box, bool open_top = false) {
         int y = box.y;
@@ -0,0 +1,125 @@
+#ifndef __tetrino_pool_hpp__
+#define __tetrino_pool_hpp__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// A fixed set of worker threads running parallel loops. Each thread owns a queue of loop
+// indices: it takes work from the front of its own queue and, once that is empty, steals from
+// the back of the others, so uneven task durations are balanced without a central queue.
+//
+// The calling thread takes part in the loop as thread 0. Only one loop may run at a time.
+class ThreadPool {
+  public:
+    explicit ThreadPool(int num_threads = std::thread::hardware_concurrency())
+        : queues(std::max(num_threads, 1)) {
+        for (int t = 1; t < size(); ++t) {
+            workers.emplace_back([this, t] { work(t); });
+        }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock{mutex};
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto &worker : workers) worker.join();
+    }
+
+    int size() const { return (int)queues.size(); }
+
+    // Call fn(i, thread) for every i in [0, n) and wait for all the calls to return. The
+    // callable may be an lvalue, const or not, or a temporary: it only lives through the call.
+    template <class F> void parallel_for(size_t n, F &&fn) {
+        using G = std::remove_reference_t<F>;
+        if (n == 0) return;
+        job = [](void *fn, size_t i, int thread) { (*static_cast<G *>(fn))(i, thread); };
+        job_fn = const_cast<void *>(static_cast<const void *>(std::addressof(fn)));
+        remaining = n;
+        for (int t = 0; t < size(); ++t) {
+            std::lock_guard lock{queues[t].mutex};
+            for (size_t i = n * t / size(); i < n * (t + 1) / size(); ++i) {
+                queues[t].items.push_back(i);
+            }
+        }
+        {
+            std::lock_guard lock{mutex};
+            generation++;
+        }
+        wake.notify_all();
+        run(0);
+        std::unique_lock lock{mutex};
+        done.wait(lock, [this] { return remaining == 0; });
+    }
+
+  private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+    };
+
+    std::vector<Queue> queues;
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stopping = false;
+    unsigned long generation = 0;
+    std::atomic<size_t> remaining;
+    void (*job)(void *, size_t, int);
+    void *job_fn;
+
+    void work(int self) {
+        unsigned long seen = 0;
+        while (true) {
+            {
+                std::unique_lock lock{mutex};
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            run(self);
+        }
+    }
+
+    void run(int self) {
+        size_t i;
+        while (take(self, i)) {
+            job(job_fn, i, self);
+            if (remaining.fetch_sub(1) == 1) {
+                std::lock_guard lock{mutex};
+                done.notify_all();
+            }
+        }
+    }
+
+    bool take(int self, size_t &i) {
+        for (int k = 0; k < size(); ++k) {
+            auto &queue = queues[(self + k) % size()];
+            std::lock_guard lock{queue.mutex};
+            if (queue.items.empty()) continue;
+            if (k == 0) {
+                i = queue.items.front();
+                queue.items.pop_front();
+            } else {
+                i = queue.items.back();
+                queue.items.pop_back();
+            }
+            return true;
+        }
+        return false;
+    }
+};
+
+#endif // __tetrino_pool_hpp__
@@ -0,0 +1,164 @@
+#ifndef __tetrino_replay_hpp__
+#define __tetrino_replay_hpp__
+
+#include "tetrino-sim.hpp"
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// An input log records games as their seed, starting level and the inputs fed to the engine,
+// which is all that is needed to replay them exactly, followed by the final score and board hash
+// to check the replay against. All numbers are LEB128 varints:
+//
+//   "TTRL" version
+//   { seed level { input + 1 }* 0 score lines board_hash }*
+//
+// where input = (time - previous time) << 4 | value << 1 | state, times being in us of game
+// time. Times never decrease, and most inputs take two or three bytes.
+struct InputLog {
+    static constexpr char magic[4] = {'T', 'T', 'R', 'L'};
+    static constexpr int version = 4;
+
+    unsigned int seed;
+    int level;
+    std::vector<Tetris::Input> inputs;
+    int score;
+    int num_lines_cleared;
+    uint64_t board_hash;
+};
+
+class InputRecorder {
+  public:
+    ~InputRecorder() { close(); }
+
+    bool open(const std::string &path) {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file) return false;
+        file.write(InputLog::magic, sizeof(InputLog::magic));
+        put(InputLog::version);
+        return true;
+    }
+
+    bool is_open() const { return file.is_open(); }
+
+    void close() {
+        in_game = false;
+        file.close();
+    }
+
+    // Record an input pushed to the engine, if a game is in progress.
+    void record(const Tetris &game, const Tetris::Input &input) {
+        if (!in_game || game.get_game_state() != Tetris::GameState::PLAY) return;
+        assert(input.time >= last_time);
+        uint64_t code = (uint64_t)(input.time - last_time) << 4 | (int)input.value << 1 |
+                        (int)input.state;
+        put(code + 1);
+        last_time = input.time;
+    }
+
+    // Call after each tic to open and close games as they start and end.
+    void update(const Tetris &game, bool alive) {
+        if (!is_open()) return;
+        bool playing = alive && game.get_game_state() == Tetris::GameState::PLAY;
+        if (!in_game && playing) {
+            put(game.get_game_seed());
+            put(game.get_level());
+            last_time = 0;
+            in_game = true;
+        } else if (in_game && !playing) {
+            put(0);
+            put(game.get_score());
+            put(game.get_num_lines_cleared());
+            put(game.get_board_hash());
+            file.flush();
+            in_game = false;
+        }
+    }
+
+  private:
+    std::ofstream file;
+    bool in_game = false;
+    ssize_t last_time;
+
+    void put(uint64_t value) {
+        do {
+            uint8_t byte = value & 0x7f;
+            value >>= 7;
+            file.put((char)(byte | (value ? 0x80 : 0)));
+        } while (value);
+    }
+};
+
+// Read all the games of an input log. Returns false if the file cannot be read or is malformed;
+// a last game interrupted before its trailer is dropped.
+inline bool read_input_log(const std::string &path, std::vector<InputLog> &games) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::vector<uint8_t> data{std::istreambuf_iterator<char>(file), {}};
+    size_t pos = sizeof(InputLog::magic);
+    if (data.size() < pos || !std::equal(data.begin(), data.begin() + pos, InputLog::magic)) {
+        return false;
+    }
+
+    bool ok = true;
+    auto get = [&]() -> uint64_t {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            if (pos >= data.size()) break;
+            uint8_t byte = data[pos++];
+            value |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) return value;
+        }
+        ok = false;
+        return 0;
+    };
+
+    if (get() != InputLog::version) return false;
+    while (pos < data.size()) {
+        InputLog game{};
+        game.seed = get();
+        game.level = get();
+        ssize_t time = 0;
+        while (ok) {
+            uint64_t code = get();
+            if (code-- == 0) break;
+            time += code >> 4;
+            game.inputs.push_back({static_cast<Tetris::Input::Value>((code >> 1) & 7),
+                                   static_cast<Tetris::Input::State>(code & 1), time});
+        }
+        game.score = get();
+        game.num_lines_cleared = get();
+        game.board_hash = get();
+        if (!ok) break;
+        games.push_back(std::move(game));
+    }
+    return true;
+}
+
+// Feeds the inputs of a log to a TetrisSim.
+class LogInputs {
+  public:
+    LogInputs(const InputLog &log) : log{log}, next{0} {}
+
+    bool operator()(const Tetris &, std::queue<Tetris::Input> &inputs) {
+        if (next >= log.inputs.size()) return false;
+        inputs.push(log.inputs[next++]);
+        return true;
+    }
+
+  private:
+    const InputLog &log;
+    size_t next;
+};
+
+// Replay a game without rendering, as fast as possible. Returns true if it ends with the
+// recorded score, number of lines and board.
+inline bool replay(const InputLog &log) {
+    TetrisSim game(log.seed);
+    game.play(LogInputs(log), log.level);
+    return game.get_score() == log.score && game.get_num_lines_cleared() == log.num_lines_cleared &&
+           game.get_board_hash() == log.board_hash;
+}
+
+#endif // __tetrino_replay_hpp__
@@ -1,12 +1,16 @@
 #ifndef __tetrino_sdl_hpp__
 #define __tetrino_sdl_hpp__
 
-#include "tetrino.hpp"
+#include "tetrino-stats.hpp"
+#include "tetrino-thread.hpp"
 
 #include <SDL.h>
 #include <SDL_ttf.h>
 #include <algorithm>
-#include <map>
+#include <array>
+#include <climits>
+#include <string_view>
+#include <vector>
 
 class TetrisSDL : public Tetris {
   public:
@@ -20,7 +24,7 @@ class TetrisSDL : public Tetris {
     TetrisSDL(const TetrisSDL &) = delete;
     TetrisSDL &operator=(const TetrisSDL &) = delete;
 
-    TetrisSDL(unsigned int seed = 0) : Tetris{seed}, last_frame_time{}, font{} {
+    TetrisSDL(unsigned int seed = 0) : Tetris{seed}, simulation{seed}, font{} {
         window = SDL_CreateWindow("Tetrino", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
                                   nominal_screen_width, nominal_screen_height,
                                   SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI);
@@ -28,28 +32,31 @@ class TetrisSDL : public Tetris {
             SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 
         update_geometry();
-        last_frame_time = (ssize_t)SDL_GetTicks64() * 1'000;
     }
 
     ~TetrisSDL() {
+        dump_stats();
+        if (atlas) SDL_DestroyTexture(atlas);
         if (font) TTF_CloseFont(font);
         SDL_DestroyRenderer(renderer);
         SDL_DestroyWindow(window);
     }
 
     bool tic() {
-        ssize_t now = (ssize_t)SDL_GetTicks64() * 1'000;
-        constexpr ssize_t two_frames = (ssize_t)(2 * 1'000'000) / 60;
-        ssize_t elapsed = std::min(now - last_frame_time, (ssize_t)20'000);
-        last_frame_time = now;
-
-        ssize_t input_frame = current_frame() + 1;
-        Tetris::Input::Value command;
+        int64_t start = FrameStats::now();
+        stats.begin_frame(start);
+        if (!simulation.is_started()) simulation.start();
+
+        // Events must be pumped by the thread of the window, once a frame, but SDL times them as
+        // they arrive: pass these times on rather than the time of the frame.
+        ssize_t now = TetrisThread::now();
+        Uint32 ticks = (Uint32)SDL_GetTicks64();
         SDL_Event event;
         while (SDL_PollEvent(&event)) {
+            ssize_t time = now - (ssize_t)(Uint32)(ticks - event.common.timestamp) * 1'000;
             if (event.type == SDL_QUIT) {
-                inputs.push({command, Tetris::Input::State::pressed, input_frame});
-                inputs.push({command, Tetris::Input::State::released, input_frame});
+                simulation.push({Tetris::Input::Value::quit, Tetris::Input::State::pressed, time});
+                simulation.push({Tetris::Input::Value::quit, Tetris::Input::State::released, time});
             } else if ((event.type == SDL_KEYUP || event.type == SDL_KEYDOWN) &&
                        event.key.repeat == 0) {
                 Tetris::Input::Value value;
@@ -64,15 +71,44 @@ class TetrisSDL : public Tetris {
                 case SDLK_x: value = Tetris::Input::Value::rotate_right; break;
                 case SDLK_c: value = Tetris::Input::Value::hold; break;
                 case SDLK_q: value = Tetris::Input::Value::quit; break;
+                case SDLK_s:
+                    if (state == Tetris::Input::State::pressed) dump_stats();
+                    continue;
                 default: continue;
                 }
-                inputs.push({value, state, input_frame});
+                simulation.push({value, state, time});
             }
         }
-        return Tetris::tic(elapsed, inputs);
+
+        // Show the latest state of the game.
+        if (simulation.update()) {
+            const auto &snapshot = simulation.snapshot();
+            load_state(snapshot.state);
+            alive = snapshot.alive;
+            stats.set_num_events(snapshot.num_events);
+            stats.set_num_missed_tics(snapshot.num_missed_tics);
+        }
+        stats.end_phase(FrameStats::TIC, start);
+        return alive;
+    }
+
+    // Record the games played to an input log.
+    bool record(const std::string &path) { return simulation.record(path); }
+
+    // Append frame statistics to a file on exit and whenever 's' is pressed.
+    bool record_stats(const std::string &path) {
+        stats_file.open(path, std::ios::app);
+        return stats_file.is_open();
+    }
+
+    void dump_stats() {
+        if (!stats_file.is_open()) return;
+        stats.print(stats_file);
+        stats_file << std::endl;
     }
 
     void draw() {
+        int64_t start = FrameStats::now();
         SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
         SDL_RenderClear(renderer);
 
@@ -83,39 +119,53 @@ class TetrisSDL : public Tetris {
         draw_text("Next", next_box.x + next_box.w / 2, next_box.y + next_box.h + 2, true);
         draw_text("Held", held_box.x + held_box.w / 2, held_box.y + held_box.h + 2, true);
 
+        // Tiles are collected by colour and drawn together by draw_tiles().
         int crop = matrix_height - skyline;
-        draw_image(matrix,          //
-                   field_box.x + 1, //
-                   field_box.y, scale, crop);
+        add_tiles(matrix,          //
+                  field_box.x + 1, //
+                  field_box.y, scale, crop);
 
-        draw_image(ghost_block,                                 //
-                   field_box.x + 1 + ghost_block.pos.x * scale, //
-                   field_box.y + (ghost_block.pos.y - crop) * scale, scale);
+        // Hide everything above the skyline except for a few pixels.
+        int top = field_box.y - scale / 2;
 
-        draw_image(block,                                 //
-                   field_box.x + 1 + block.pos.x * scale, //
-                   field_box.y + (block.pos.y - crop) * scale, scale);
-
-        {
-            // Hide everything above the skyline except for a few pixels.
-            SDL_Rect hide = {field_box.x + 1, 0, field_box.w - 2, field_box.y - scale / 2};
-            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-            SDL_RenderFillRect(renderer, &hide);
+        if (ghost_block.type != Tetrimino::none) {
+            add_tiles(ghost_block.image(),                          //
+                      field_box.x + 1 + ghost_block.pos.x * scale, //
+                      field_box.y + (ghost_block.pos.y - crop) * scale, scale, 0, top);
         }
 
-        draw_image(next_block, next_box.x + 1, next_box.y + 1, scale);
+        add_tiles(block.image(),                         //
+                  field_box.x + 1 + block.pos.x * scale, //
+                  field_box.y + (block.pos.y - crop) * scale, scale, 0, top);
+
+        add_tiles(Tetrimino(preview(0)).image(), next_box.x + 1, next_box.y + 1, scale);
+
+        if (preview_depth > 1) {
+            // The pieces after the next one, at half scale, 3 rows each.
+            int s = scale / 2;
+            SDL_Rect box = {queue_box.x, queue_box.y, queue_box.w, (preview_depth - 1) * 3 * s + s};
+            SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+            SDL_RenderDrawRect(renderer, &box);
+            for (int k = 1; k < preview_depth; ++k) {
+                Tetrimino piece(preview(k));
+                add_tiles(piece.image(), queue_box.x + 1 + 2 * s,
+                          queue_box.y + s / 2 + (k - 1) * 3 * s, s, piece.bounds().top);
+            }
+        }
 
         if (held_block.type != Tetrimino::none) {
-            draw_image(held_block, held_box.x + 1, held_box.y + 1, scale);
+            add_tiles(held_block.image(), held_box.x + 1, held_box.y + 1, scale);
         }
 
+        draw_tiles();
+
         draw_text(std::string{"Score "} + std::to_string(tally), right_score_box.x,
                   right_score_box.y);
 
         for (int i = 0; i < 5; ++i) {
-            int m = messages.size() - i - 1;
-            if (m < 0) break;
-            draw_text(messages[m], right_score_box.x, right_score_box.y + line_skip * (3 + i));
+            if (i >= get_num_score_events()) break;
+            draw_text(get_score_event(i).text(), right_score_box.x,
+                      right_score_box.y + line_skip * (3 + i));
         }
 
         draw_text(std::string{"Level "} + std::to_string(level), left_score_box.x,
@@ -150,12 +200,18 @@ class TetrisSDL : public Tetris {
             draw_text(msg, info_box.x + info_box.w / 2, info_box.y + (info_box.h - text_height) / 2,
                       true);
         }
+        stats.end_phase(FrameStats::DRAW, start);
     }
 
-    void present() { SDL_RenderPresent(renderer); }
+    // Waits for the vertical sync, which paces the game loop.
+    void present() {
+        int64_t start = FrameStats::now();
+        SDL_RenderPresent(renderer);
+        stats.end_phase(FrameStats::PRESENT, start);
+    }
 
   protected:
-    std::queue<Tetris::Input> inputs;
+    TetrisThread simulation;
 
     int scale;
     int screen_width;
@@ -163,6 +219,7 @@ class TetrisSDL : public Tetris {
     SDL_Rect field_box;
     SDL_Rect info_box;
     SDL_Rect next_box;
+    SDL_Rect queue_box;
     SDL_Rect held_box;
     SDL_Rect right_score_box;
     SDL_Rect left_score_box;
@@ -174,7 +231,8 @@ class TetrisSDL : public Tetris {
     int font_size;
     int font_height;
     int line_skip;
-    ssize_t last_frame_time;
+    FrameStats stats;
+    std::ofstream stats_file;
 
     void update_geometry() {
         SDL_GetRendererOutputSize(renderer, &screen_width, &screen_height);
@@ -191,6 +249,7 @@ class TetrisSDL : public Tetris {
         assert(font);
         font_height = TTF_FontHeight(font);
         line_skip = TTF_FontLineSkip(font);
+        build_glyph_atlas();
 
         field_box = {.x = (screen_width - (matrix_width * scale + 2)) / 2, //
                      .y = (screen_height - (skyline * scale + 1)) / 2,     //
@@ -214,14 +273,19 @@ class TetrisSDL : public Tetris {
                     .w = next_box.w,                                      //
                     .h = next_box.h};
 
+        queue_box = {.x = next_box.x,                                  //
+                     .y = next_box.y + next_box.h + 3 * line_skip,         //
+                     .w = next_box.w,                                      //
+                     .h = (max_preview - 1) * 3 * (scale / 2) + scale / 2};
+
         right_score_box = {.x = field_box.x + field_box.w + pad,                      //
-                           .y = next_box.y + next_box.h + 3 * line_skip,              //
+                           .y = queue_box.y + queue_box.h + 2 * line_skip,            //
                            .w = screen_width - (field_box.x + field_box.w + 2 * pad), //
-                           .h = screen_height - (next_box.y + next_box.h + 2 * pad)};
+                           .h = screen_height - (queue_box.y + queue_box.h + 2 * pad)};
 
-        left_score_box = {.x = pad,                   //
-                          .y = right_score_box.y,     //
-                          .w = field_box.x - 2 * pad, //
+        left_score_box = {.x = pad,                                     //
+                          .y = next_box.y + next_box.h + 3 * line_skip, //
+                          .w = field_box.x - 2 * pad,                   //
                           .h = right_score_box.h};
     }
 
@@ -241,42 +305,129 @@ class TetrisSDL : public Tetris {
         return color;
     }
 
-    template <int W, int H>
-    void draw_image(const Image<W, H> &image, int x, int y, int s, int crop_top = 0) {
-        for (int r = crop_top; r < H; ++r) {
-            for (int c = 0; c < W; ++c) {
+    // Tiles waiting to be drawn, one batch per colour, from I to G. The batches keep their
+    // capacity from frame to frame.
+    std::array<std::vector<SDL_Rect>, Tetrimino::G - Tetrimino::I + 1> tile_batches;
+
+    // Queue the tiles of an image, scaled by s, with the rows from crop_top on placed at (x, y).
+    // Tiles are clipped above min_y.
+    template <class I>
+    void add_tiles(const I &image, int x, int y, int s, int crop_top = 0, int min_y = INT_MIN) {
+        for (int r = crop_top; r < I::height; ++r) {
+            for (int c = 0; c < I::width; ++c) {
                 int type = image[{c, r}];
-                if (type == 0) continue;
+                if (type < Tetrimino::I || type > Tetrimino::G) continue;
                 SDL_Rect tile{.x = x + c * s, //
                               .y = y + (r - crop_top) * s,
                               .w = s,
                               .h = s};
-                auto color = get_tetrimino_color(static_cast<Tetrimino::type_t>(type));
-                SDL_SetRenderDrawColor(renderer, color[0], color[1], color[2], 255);
-                SDL_RenderFillRect(renderer, &tile);
+                if (tile.y < min_y) {
+                    tile.h -= min_y - tile.y;
+                    tile.y = min_y;
+                    if (tile.h <= 0) continue;
+                }
+                tile_batches[type - Tetrimino::I].push_back(tile);
             }
         }
     }
 
-    // Cache text strings for efficiency.
-    struct TextureDeleter {
-        void operator()(SDL_Texture *t) { SDL_DestroyTexture(t); }
+    // Draw the queued tiles with one SDL_RenderFillRects call per colour.
+    void draw_tiles() {
+        for (int i = 0; i < (int)tile_batches.size(); ++i) {
+            auto &batch = tile_batches[i];
+            if (batch.empty()) continue;
+            auto color = get_tetrimino_color(static_cast<Tetrimino::type_t>(Tetrimino::I + i));
+            SDL_SetRenderDrawColor(renderer, color[0], color[1], color[2], 255);
+            SDL_RenderFillRects(renderer, batch.data(), batch.size());
+            batch.clear();
+        }
+    }
+
+    // Atlas of the printable ASCII glyphs of the font, built by build_glyph_atlas() whenever the
+    // font changes. Text is drawn as one textured quad per character.
+    static constexpr char first_glyph = ' ';
+    static constexpr char last_glyph = '~';
+    static constexpr int num_glyphs = last_glyph - first_glyph + 1;
+    struct AtlasGlyph {
+        SDL_Rect src;
+        int advance;
     };
-    std::map<std::string, std::unique_ptr<SDL_Texture, TextureDeleter>> strings;
-
-    void draw_text(const std::string &str, int x, int y, bool center = false) {
-        if (strings.count(str) == 0) {
-            SDL_Color color = {255, 255, 255};
-            SDL_Surface *surface = TTF_RenderUTF8_Solid_Wrapped(font, str.c_str(), color, 0L);
-            SDL_Texture *text = SDL_CreateTextureFromSurface(renderer, surface);
-            SDL_FreeSurface(surface);
-            strings[str] = std::unique_ptr<SDL_Texture, TextureDeleter>{text};
+    std::array<AtlasGlyph, num_glyphs> glyphs;
+    SDL_Texture *atlas = nullptr;
+    int atlas_width;
+    int atlas_height;
+    std::vector<SDL_Vertex> text_vertices;
+    std::vector<int> text_indices;
+
+    void build_glyph_atlas() {
+        if (atlas) SDL_DestroyTexture(atlas);
+        SDL_Color white = {255, 255, 255, 255};
+        std::array<SDL_Surface *, num_glyphs> surfaces;
+        atlas_width = 0;
+        atlas_height = font_height;
+        for (int i = 0; i < num_glyphs; ++i) {
+            uint16_t c = first_glyph + i;
+            surfaces[i] = TTF_RenderGlyph_Blended(font, c, white);
+            assert(surfaces[i]);
+            int minx, maxx, miny, maxy, advance;
+            TTF_GlyphMetrics(font, c, &minx, &maxx, &miny, &maxy, &advance);
+            glyphs[i] = {{atlas_width, 0, surfaces[i]->w, surfaces[i]->h}, advance};
+            atlas_width += surfaces[i]->w;
+            atlas_height = std::max(atlas_height, surfaces[i]->h);
+        }
+        SDL_Surface *surface =
+            SDL_CreateRGBSurfaceWithFormat(0, atlas_width, atlas_height, 32, SDL_PIXELFORMAT_RGBA32);
+        for (int i = 0; i < num_glyphs; ++i) {
+            // Copy the glyphs with their alpha instead of blending them onto the empty atlas.
+            SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+            SDL_BlitSurface(surfaces[i], nullptr, surface, &glyphs[i].src);
+            SDL_FreeSurface(surfaces[i]);
+        }
+        atlas = SDL_CreateTextureFromSurface(renderer, surface);
+        SDL_FreeSurface(surface);
+        SDL_SetTextureBlendMode(atlas, SDL_BLENDMODE_BLEND);
+    }
+
+    const AtlasGlyph &get_glyph(char c) const {
+        if (c < first_glyph || c > last_glyph) c = '?';
+        return glyphs[c - first_glyph];
+    }
+
+    // Draw a text with its top left corner, or top centre, at (x, y), in one SDL_RenderGeometry
+    // call. Lines are separated by '\n'.
+    void draw_text(std::string_view str, int x, int y, bool center = false) {
+        int width = 0, line_width = 0;
+        for (char c : str) {
+            line_width = (c == '\n') ? 0 : line_width + get_glyph(c).advance;
+            width = std::max(width, line_width);
+        }
+
+        text_vertices.clear();
+        text_indices.clear();
+        float left = x - (center ? width / 2 : 0), pen = left, top = y;
+        for (char c : str) {
+            if (c == '\n') {
+                pen = left;
+                top += line_skip;
+                continue;
+            }
+            const auto &glyph = get_glyph(c);
+            float u0 = (float)glyph.src.x / atlas_width;
+            float u1 = (float)(glyph.src.x + glyph.src.w) / atlas_width;
+            float v1 = (float)glyph.src.h / atlas_height;
+            float x1 = pen + glyph.src.w, y1 = top + glyph.src.h;
+            int n = text_vertices.size();
+            SDL_Color color = {255, 255, 255, 255};
+            text_vertices.push_back({{pen, top}, color, {u0, 0}});
+            text_vertices.push_back({{x1, top}, color, {u1, 0}});
+            text_vertices.push_back({{x1, y1}, color, {u1, v1}});
+            text_vertices.push_back({{pen, y1}, color, {u0, v1}});
+            for (int k : {0, 1, 2, 0, 2, 3}) text_indices.push_back(n + k);
+            pen += glyph.advance;
         }
-        SDL_Texture *text = strings[str].get();
-        int w, h;
-        SDL_QueryTexture(text, nullptr, nullptr, &w, &h);
-        SDL_Rect rect{x - (center ? w / 2 : 0), y, w, h};
-        SDL_RenderCopy(renderer, text, NULL, &rect);
+        if (text_vertices.empty()) return;
+        SDL_RenderGeometry(renderer, atlas, text_vertices.data(), text_vertices.size(),
+                           text_indices.data(), text_indices.size());
     }
 };
 
@@ -0,0 +1,55 @@
+#ifndef __tetrino_sim_hpp__
+#define __tetrino_sim_hpp__
+
+#include "tetrino.hpp"
+
+#include <random>
+
+// Runs Tetris without a renderer on a virtual clock. Instead of stepping one frame at a time,
+// the clock jumps straight to the next fall, lock, repeated translation or input, so a game runs
+// as fast as the engine can process its events.
+class TetrisSim : public Tetris {
+  public:
+    TetrisSim(unsigned int seed = 0) : Tetris(seed) {}
+
+    // Play a game until it is over, the input source is exhausted or `max_time` is reached.
+    //
+    // The source is called as `source(game, inputs)` whenever the input queue is empty. It may
+    // push inputs timed not earlier than `game.get_game_time()`, and returns false once it
+    // has nothing more to say, after which the game runs on gravity alone.
+    template <class Source> void play(Source &&source, int level = 1, ssize_t max_time = never) {
+        new_game(level);
+        bool has_inputs = true;
+        while (game_state == GameState::PLAY && alive) {
+            if (inputs.empty() && has_inputs) has_inputs = source(*this, inputs);
+            ssize_t input_time = inputs.empty() ? never : inputs.front().time;
+            ssize_t time = std::max(std::min(get_next_event_time(), input_time), game_time);
+            if (time >= max_time) break;
+            Tetris::tic(time - game_time, inputs);
+        }
+    }
+
+  protected:
+    std::queue<Tetris::Input> inputs;
+};
+
+// An input source pressing random keys at random intervals, useful to exercise the engine.
+class RandomInputs {
+  public:
+    RandomInputs(unsigned int seed = 0) : rng{seed} {}
+
+    bool operator()(const Tetris &game, std::queue<Tetris::Input> &inputs) {
+        using IN = Tetris::Input;
+        auto value = static_cast<IN::Value>(rng() % (int)IN::Value::quit);
+        ssize_t frame = game.current_frame() + 1 + rng() % 20;
+        inputs.push({value, IN::State::pressed, frame * Tetris::frame_period});
+        inputs.push({value, IN::State::released,
+                     (frame + (ssize_t)(rng() % 10)) * Tetris::frame_period});
+        return true;
+    }
+
+  private:
+    std::mt19937 rng;
+};
+
+#endif // __tetrino_sim_hpp__
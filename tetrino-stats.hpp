@@ -0,0 +1,131 @@
+#ifndef __tetrino_stats_hpp__
+#define __tetrino_stats_hpp__
+
+#include "tetrino.hpp"
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+
+// A histogram of non-negative values with log-linear buckets, HDR style: values below 32 have a
+// bucket each, and every further power of two is split into 16 buckets, so that any value is
+// known to within 1/16 of itself. It takes a fixed 8 kB and recording a value is a few
+// instructions.
+class Histogram {
+  public:
+    static constexpr int sub_buckets = 16;
+    static constexpr int num_buckets = (64 - 4) * sub_buckets + 2 * sub_buckets;
+
+    void record(int64_t value) {
+        uint64_t v = std::max<int64_t>(value, 0);
+        counts[bucket(v)]++;
+        count++;
+        sum += v;
+        max = std::max(max, v);
+    }
+
+    uint64_t get_count() const { return count; }
+    uint64_t get_max() const { return max; }
+    double get_mean() const { return count ? (double)sum / count : 0; }
+
+    // Smallest bucket bound not exceeded by a fraction q of the values.
+    uint64_t quantile(double q) const {
+        uint64_t rank = (uint64_t)(q * count), seen = 0;
+        for (int i = 0; i < num_buckets; ++i) {
+            seen += counts[i];
+            if (seen > rank) return std::min(upper_bound(i), max);
+        }
+        return max;
+    }
+
+    static constexpr int bucket(uint64_t v) {
+        if (v < 2 * sub_buckets) return (int)v;
+        int shift = std::bit_width(v) - 5;
+        return shift * sub_buckets + (int)(v >> shift);
+    }
+
+    static constexpr uint64_t upper_bound(int i) {
+        if (i < 2 * sub_buckets) return i;
+        int shift = i / sub_buckets - 1;
+        return ((uint64_t)(i % sub_buckets + sub_buckets + 1) << shift) - 1;
+    }
+
+  private:
+    std::array<uint64_t, num_buckets> counts{};
+    uint64_t count = 0;
+    uint64_t sum = 0;
+    uint64_t max = 0;
+};
+
+// Where the time of the game loop goes: the duration of each phase of a frame, how far the
+// interval between frames is from Tetris::frame_period, how many engine events were run between
+// the snapshots drawn, and how many frames and tics started after their deadline. Times are in ns.
+class FrameStats {
+  public:
+    enum Phase { TIC, DRAW, PRESENT, THROTTLE, num_phases };
+
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+    }
+
+    // Call at the start of each frame.
+    void begin_frame(int64_t time) {
+        if (last_frame_time >= 0) {
+            int64_t deviation = time - last_frame_time - Tetris::frame_period * 1'000;
+            jitter.record(deviation < 0 ? -deviation : deviation);
+        }
+        last_frame_time = time;
+    }
+
+    // Record a phase which started at `start` and ends now.
+    void end_phase(Phase phase, int64_t start) { phases[phase].record(now() - start); }
+
+    // Record the events run since the last call, from the total run so far, so that the events of
+    // the tics whose snapshots were never drawn are counted too.
+    void set_num_events(uint64_t n) {
+        events.record(n - num_events);
+        num_events = n;
+    }
+
+    void record_missed_deadline() { num_missed_frames++; }
+    void set_num_missed_tics(uint64_t n) { num_missed_tics = n; }
+
+    void print(std::ostream &os) const {
+        static constexpr const char *phase_names[] = {"tic", "draw", "present", "throttle"};
+        os << "frames: " << phases[TIC].get_count() << "\n"
+           << std::left << std::setw(12) << "" << std::right << std::setw(10) << "mean"
+           << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+           << std::setw(10) << "p99.9" << std::setw(10) << "max" << '\n';
+        for (int p = 0; p < num_phases; ++p) {
+            print_row(os, std::string{phase_names[p]} + " us", phases[p], 1e-3);
+        }
+        print_row(os, "jitter us", jitter, 1e-3);
+        print_row(os, "events", events, 1);
+        os << "missed deadlines: " << num_missed_frames << " frames, " << num_missed_tics
+           << " tics\n";
+    }
+
+  private:
+    std::array<Histogram, num_phases> phases;
+    Histogram jitter;
+    Histogram events;
+    uint64_t num_events = 0;
+    uint64_t num_missed_frames = 0;
+    uint64_t num_missed_tics = 0;
+    int64_t last_frame_time = -1;
+
+    static void print_row(std::ostream &os, const std::string &name, const Histogram &h,
+                          double unit) {
+        os << std::left << std::setw(12) << name << std::right << std::fixed
+           << std::setprecision(1) << std::setw(10) << h.get_mean() * unit;
+        for (double q : {0.5, 0.9, 0.99, 0.999}) os << std::setw(10) << h.quantile(q) * unit;
+        os << std::setw(10) << h.get_max() * unit << '\n' << std::defaultfloat;
+    }
+};
+
+#endif // __tetrino_stats_hpp__
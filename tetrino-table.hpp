@@ -0,0 +1,63 @@
+#ifndef __tetrino_table_hpp__
+#define __tetrino_table_hpp__
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+// A fixed-size cache of values keyed by 64-bit hashes such as Tetris::get_position_hash, shared
+// by any number of threads without locks. Each slot holds a value and the key xored with it, both
+// stored as relaxed atomics: a slot torn by concurrent stores almost never passes the check, and
+// reads as a miss. As with any lockless hashing, it may by chance, much as hashes may collide.
+// A store simply replaces what the slot held.
+template <class T> class TranspositionTable {
+    static_assert(std::is_trivially_copyable_v<T> && sizeof(T) <= sizeof(uint64_t));
+
+  public:
+    // 2^bits slots.
+    explicit TranspositionTable(int bits)
+        : mask{((size_t)1 << bits) - 1}, slots{std::make_unique<Slot[]>(mask + 1)} {
+        assert(0 <= bits && bits < 48);
+    }
+
+    size_t size() const { return mask + 1; }
+
+    // Returns false if the key is not in the table.
+    bool find(uint64_t key, T &value) const {
+        const Slot &slot = slots[key & mask];
+        uint64_t data = slot.data.load(std::memory_order_relaxed);
+        if ((slot.check.load(std::memory_order_relaxed) ^ data) != key) return false;
+        std::memcpy(&value, &data, sizeof(T));
+        return true;
+    }
+
+    void store(uint64_t key, const T &value) {
+        uint64_t data = 0;
+        std::memcpy(&data, &value, sizeof(T));
+        Slot &slot = slots[key & mask];
+        slot.check.store(key ^ data, std::memory_order_relaxed);
+        slot.data.store(data, std::memory_order_relaxed);
+    }
+
+    // Not safe while other threads use the table.
+    void clear() {
+        for (size_t i = 0; i < size(); ++i) {
+            slots[i].check.store(0, std::memory_order_relaxed);
+            slots[i].data.store(0, std::memory_order_relaxed);
+        }
+    }
+
+  private:
+    struct Slot {
+        std::atomic<uint64_t> check{0};
+        std::atomic<uint64_t> data{0};
+    };
+
+    size_t mask;
+    std::unique_ptr<Slot[]> slots;
+};
+
+#endif // __tetrino_table_hpp__
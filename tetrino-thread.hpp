@@ -0,0 +1,259 @@
+#ifndef __tetrino_thread_hpp__
+#define __tetrino_thread_hpp__
+
+#include "tetrino-replay.hpp"
+
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <string>
+#include <thread>
+
+#include <time.h>
+
+// A bounded queue between one producer thread and one consumer thread, without locks. N must be
+// a power of two.
+template <class T, size_t N> class SpscRing {
+    static_assert(N > 0 && (N & (N - 1)) == 0);
+
+  public:
+    // Producer side. Fails if the ring is full.
+    bool push(const T &item) {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) == N) return false;
+        items[h % N] = item;
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side. Fails if the ring is empty.
+    bool pop(T &item) {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire)) return false;
+        item = items[t % N];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+  private:
+    std::array<T, N> items{};
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+// Hands the latest of a stream of values from one writer thread to one reader thread, without
+// locks and without either side ever waiting for the other. The writer fills the back slot and
+// publishes it by swapping it with the middle one; the reader swaps the middle slot with its
+// front one whenever a fresh value is there. Values the reader is too slow to see are dropped.
+template <class T> class TripleBuffer {
+  public:
+    // Writer side.
+    T &back() { return slots[back_index].value; }
+
+    void publish() {
+        back_index = middle.exchange(back_index | fresh, std::memory_order_acq_rel) & index_mask;
+    }
+
+    // Reader side. Returns true if a value was published since the last call.
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & fresh)) return false;
+        front_index = middle.exchange(front_index, std::memory_order_acq_rel) & index_mask;
+        return true;
+    }
+
+    const T &front() const { return slots[front_index].value; }
+
+  private:
+    static constexpr int index_mask = 3;
+    static constexpr int fresh = 4;
+
+    struct alignas(64) Slot {
+        T value;
+    };
+    std::array<Slot, 3> slots{};
+    int back_index = 0;
+    alignas(64) std::atomic<int> middle{1};
+    alignas(64) int front_index = 2;
+};
+
+// Paces a loop to absolute deadlines on CLOCK_MONOTONIC, one period apart and the first one
+// period after construction, so that late wake-ups do not add up to drift as they do when
+// sleeping for a duration. The last `spin` ns before a deadline may be busy-waited rather than
+// slept, which trades CPU time for precision. A loop reaching wait() after its deadline has
+// missed it, and goes on without sleeping; after a stall of more than max_lag periods, the
+// pacer starts over from now rather than run a burst of late frames. Times are in ns.
+class FramePacer {
+  public:
+    static constexpr int max_lag = 2;
+
+    explicit FramePacer(int64_t period, int64_t spin = 0)
+        : period{period}, spin{spin}, deadline{now() + period}, last_deadline{now()} {}
+
+    static int64_t now() {
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (int64_t)ts.tv_sec * 1'000'000'000 + ts.tv_nsec;
+    }
+
+    void set_spin(int64_t spin) { this->spin = spin; }
+
+    // Wait for the next deadline. Returns false if it was already past.
+    bool wait() {
+        int64_t time = now();
+        bool on_time = time <= deadline;
+        if (on_time) {
+            if (deadline - time > spin) {
+                int64_t wake = deadline - spin;
+                timespec ts{(time_t)(wake / 1'000'000'000), (long)(wake % 1'000'000'000)};
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+                }
+            }
+            while (now() < deadline) {
+            }
+        } else {
+            num_missed++;
+            if (time - deadline > max_lag * period) deadline = time;
+        }
+        last_deadline = deadline;
+        deadline += period;
+        return on_time;
+    }
+
+    // The deadline last waited for, which is when the current frame is due to have started.
+    int64_t get_last_deadline() const { return last_deadline; }
+    uint64_t get_num_missed() const { return num_missed; }
+
+  private:
+    int64_t period;
+    int64_t spin;
+    int64_t deadline;
+    int64_t last_deadline;
+    uint64_t num_missed = 0;
+};
+
+// Runs a game on a thread of its own, one Tetris::tic per frame_period, so that the simulation
+// keeps its pace however long the frames take to render. The front end pushes its inputs from a
+// single thread, timed when they were read, and draws from the snapshots published after every
+// tic.
+//
+// The game runs one frame behind the wall clock: each tic simulates the frame which has just
+// passed, and the inputs read during that frame take effect at the matching point of game time,
+// to the microsecond.
+class TetrisThread {
+  public:
+    struct Command {
+        Tetris::Input::Value value;
+        Tetris::Input::State state;
+        ssize_t time; // us of now(), on CLOCK_MONOTONIC
+    };
+
+    static ssize_t now() { return FramePacer::now() / 1'000; }
+
+    struct Snapshot {
+        Tetris::State state;
+        bool alive;
+        uint64_t num_events; // run by all the tics so far, see Tetris::get_num_tic_events
+        uint64_t num_missed_tics;
+    };
+
+    // Makes inputs of its own, as the sources of TetrisSim::play do.
+    using Source = std::function<bool(const Tetris &game, std::queue<Tetris::Input> &inputs)>;
+
+    explicit TetrisThread(unsigned int seed = 0) : game(seed) {}
+
+    TetrisThread(const TetrisThread &) = delete;
+    TetrisThread &operator=(const TetrisThread &) = delete;
+
+    ~TetrisThread() { stop(); }
+
+    // Record the games played to an input log. Call before start().
+    bool record(const std::string &path) {
+        assert(!thread.joinable());
+        return recorder.open(path);
+    }
+
+    // Also play the inputs of `source`, which is called on the simulation thread whenever no input
+    // is pending, until it returns false. Call before start().
+    void set_source(Source source) {
+        assert(!thread.joinable());
+        this->source = std::move(source);
+    }
+
+    // Call before start().
+    void set_preview_depth(int depth) {
+        assert(!thread.joinable());
+        game.set_preview_depth(depth);
+    }
+
+    void start() {
+        assert(!thread.joinable());
+        thread = std::thread([this] { run(); });
+    }
+
+    void stop() {
+        stopping = true;
+        if (thread.joinable()) thread.join();
+    }
+
+    bool is_started() const { return thread.joinable(); }
+
+    // Fails if the simulation is too far behind to take more inputs.
+    bool push(const Command &command) { return commands.push(command); }
+
+    // Returns true if a new snapshot is available from snapshot().
+    bool update() { return snapshots.update(); }
+    const Snapshot &snapshot() const { return snapshots.front(); }
+
+  private:
+    Tetris game;
+    InputRecorder recorder;
+    Source source;
+    SpscRing<Command, 64> commands;
+    TripleBuffer<Snapshot> snapshots;
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+
+    void run() {
+        FramePacer pacer(Tetris::frame_period * 1'000);
+        std::queue<Tetris::Input> inputs, generated;
+        // Wall clock time of the last tic, and the game time it brought the game to.
+        ssize_t tic_time = now(), tic_game_time = game.get_game_time();
+        uint64_t num_events = 0;
+        bool alive = true;
+        while (alive && !stopping) {
+            pacer.wait();
+            Command command;
+            while (commands.pop(command)) {
+                // Inputs must not go back in time, even if read before the last tic.
+                ssize_t time = std::max({tic_game_time + (command.time - tic_time),
+                                         game.get_game_time(),
+                                         inputs.empty() ? 0 : inputs.back().time});
+                Tetris::Input input{command.value, command.state, time};
+                recorder.record(game, input);
+                inputs.push(input);
+            }
+            if (source && inputs.empty()) {
+                if (!source(game, generated)) source = nullptr;
+                for (; !generated.empty(); generated.pop()) {
+                    recorder.record(game, generated.front());
+                    inputs.push(generated.front());
+                }
+            }
+            alive = game.tic(Tetris::frame_period, inputs);
+            recorder.update(game, alive);
+            tic_time = pacer.get_last_deadline() / 1'000;
+            tic_game_time = game.get_game_time();
+
+            num_events += game.get_num_tic_events();
+            snapshots.back() = {game.save_state(), alive, num_events,
+                                pacer.get_num_missed()};
+            snapshots.publish();
+        }
+    }
+};
+
+#endif // __tetrino_thread_hpp__
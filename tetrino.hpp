@@ -3,13 +3,18 @@
 
 #include <algorithm>
 #include <array>
+#include <bit>
 #include <cassert>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <limits>
 #include <queue>
-#include <random>
 #include <span>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 struct Point {
     int x;
@@ -21,6 +26,7 @@ struct Point {
         return *this;
     }
     constexpr Point operator*(int s) const { return {x * s, y * s}; }
+    constexpr bool operator==(const Point &) const = default;
 };
 
 constexpr Point shift_down{0, 1};
@@ -33,10 +39,10 @@ template <int W, int H = W> class Image {
     static constexpr int height = H;
     std::array<int, width * height> data;
 
-    Image() { clear(); }
+    constexpr Image() : data{} { clear(); }
 
-    int &operator[](Point p) { return data[p.x + p.y * width]; }
-    const int &operator[](Point p) const { return data[p.x + p.y * width]; }
+    constexpr int &operator[](Point p) { return data[p.x + p.y * width]; }
+    constexpr const int &operator[](Point p) const { return data[p.x + p.y * width]; }
 
     std::span<int, width> operator[](int y) {
         return std::span{data}.subspan(y * width).template first<width>();
@@ -46,7 +52,7 @@ template <int W, int H = W> class Image {
         return std::span{data}.subspan(y * width).template first<width>();
     }
 
-    void clear(int value = ' ') { data.fill(value); }
+    constexpr void clear(int value = ' ') { data.fill(value); }
 
     template <int OW, int OH>
     bool can_paste(const Image<OW, OH> &image, Point p, int xscale = 1, int crop_top = 0) const {
@@ -58,7 +64,7 @@ template <int W, int H = W> class Image {
         return paste<false, OW, OH>(image, p, xscale, crop_top);
     }
 
-    void rotate_clockwise(int window) {
+    constexpr void rotate_clockwise(int window) {
         assert(0 <= window && window <= width && window <= height);
         for (int y = 0; y < window; ++y) {
             for (int x = 0; x < y; ++x) {
@@ -97,7 +103,11 @@ template <int W, int H = W> class Image {
     }
 };
 
-class Tetrimino : public Image<4> {
+struct Bounds {
+    int left, top, right, bottom; // inclusive
+};
+
+class Tetrimino {
   public:
     enum type_t { none = 0, I = 256, L, O, T, J, Z, S, G } type;
     Point pos;
@@ -105,24 +115,37 @@ class Tetrimino : public Image<4> {
 
     static constexpr int size = 4;
 
-    Tetrimino(type_t type = I) : type{type}, pos{0, 0} { rotate(0); }
+    constexpr Tetrimino(type_t type = I) : type{type}, pos{0, 0}, rot{0}, ghost{false} {}
 
-    void rotate(int r) {
-        rot = r;
-        auto index = index_from_type(type);
-        this->data = Tetrimino::defaults.shape[index][rot].data;
-    }
+    constexpr bool operator==(const Tetrimino &) const = default;
 
+    void rotate(int r) { rot = r; }
+
+    // Draw the tetrimino with the ghost colour.
     void recolor(type_t value) {
-        std::transform(begin(this->data), end(this->data), begin(this->data),
-                       [=](int c) { return c ? value : 0; });
+        assert(value == type || value == G);
+        ghost = (value == G);
     }
 
-    inline static const std::array<type_t, 7> all_types{I, L, O, T, J, Z, S};
-    inline static constexpr int num_tetriminoes = all_types.size();
+    // Tiles of the current rotation: 0 if transparent, the tetrimino (or ghost) type otherwise.
+    const Image<size> &image() const;
+
+    // Occupancy of each row of the current rotation, bit x standing for column x.
+    const std::array<uint16_t, size> &mask() const;
+
+    // Smallest box containing the occupied tiles of the current rotation.
+    const Bounds &bounds() const;
+
+    // Lowest occupied row of each column of the current rotation, -1 for empty columns.
+    const std::array<int8_t, size> &bottoms() const;
+
+    static constexpr std::array<type_t, 7> all_types{I, L, O, T, J, Z, S};
+    static constexpr int num_tetriminoes = all_types.size();
 
   private:
-    inline static const int index_from_type(type_t type) {
+    bool ghost;
+
+    static constexpr int index_from_type(type_t type) {
         switch (type) {
         case I: return 0;
         case L: return 1;
@@ -136,21 +159,44 @@ class Tetrimino : public Image<4> {
         }
     }
 
-    inline static const struct Defaults {
-        std::array<std::array<Image<size>, 4>, num_tetriminoes> shape;
+    // All shapes, rotations and derived data, computed at compile time. Like the kick tables
+    // below, it is immutable, so any number of games may run concurrently on different threads.
+    struct Defaults {
+        template <class T> using table = std::array<std::array<T, 4>, num_tetriminoes>;
+        std::array<table<Image<size>>, 2> shape; // [ghost][type][rot]
+        table<std::array<uint16_t, size>> mask;
+        table<Bounds> bounds;
+        table<std::array<int8_t, size>> bottoms;
 
-        void make(type_t type, int window, const char (&support)[size * size + 1]) {
+        constexpr void make(type_t type, int window, const char (&support)[size * size + 1]) {
             int index = index_from_type(type);
-            std::transform(
-                std::begin(support), std::begin(support) + Tetrimino::size * Tetrimino::size,
-                begin(shape[index][0].data), [=](char c) { return (c == ' ') ? 0 : (int)type; });
+            for (int i = 0; i < size * size; ++i) {
+                shape[0][index][0].data[i] = (support[i] == ' ') ? 0 : (int)type;
+            }
             for (int r = 1; r < 4; ++r) {
-                shape[index][r].data = shape[index][r - 1].data;
-                shape[index][r].rotate_clockwise(window);
+                shape[0][index][r] = shape[0][index][r - 1];
+                shape[0][index][r].rotate_clockwise(window);
+            }
+            for (int r = 0; r < 4; ++r) {
+                const auto &image = shape[0][index][r];
+                Bounds b{size, size, -1, -1};
+                bottoms[index][r].fill(-1);
+                for (int y = 0; y < size; ++y) {
+                    mask[index][r][y] = 0;
+                    for (int x = 0; x < size; ++x) {
+                        shape[1][index][r][{x, y}] = image[{x, y}] ? (int)G : 0;
+                        if (!image[{x, y}]) continue;
+                        mask[index][r][y] |= 1 << x;
+                        bottoms[index][r][x] = y;
+                        b = {std::min(b.left, x), std::min(b.top, y), std::max(b.right, x),
+                             std::max(b.bottom, y)};
+                    }
+                }
+                bounds[index][r] = b;
             }
         }
 
-        Defaults() {
+        constexpr Defaults() : shape{}, mask{}, bounds{}, bottoms{} {
             make(I, 4,
                  "    "
                  "####"
@@ -187,11 +233,401 @@ class Tetrimino : public Image<4> {
                  "    "
                  "    ");
         }
-    } defaults;
+    };
+
+    static const Defaults defaults;
+};
+
+inline constexpr Tetrimino::Defaults Tetrimino::defaults{};
+
+inline const Image<Tetrimino::size> &Tetrimino::image() const {
+    return defaults.shape[ghost][index_from_type(type)][rot];
+}
+
+inline const std::array<uint16_t, Tetrimino::size> &Tetrimino::mask() const {
+    return defaults.mask[index_from_type(type)][rot];
+}
+
+inline const Bounds &Tetrimino::bounds() const { return defaults.bounds[index_from_type(type)][rot]; }
+
+inline const std::array<int8_t, Tetrimino::size> &Tetrimino::bottoms() const {
+    return defaults.bottoms[index_from_type(type)][rot];
+}
+
+// Counter-based 7-bag randomizer. The contents of bag k of a game are a pure function of the
+// game seed and k, so any piece of the sequence can be computed directly, there is no generator
+// state to carry around and lookahead is free.
+struct BagRandomizer {
+    using Bag = std::array<Tetrimino::type_t, Tetrimino::num_tetriminoes>;
+
+    // SplitMix64 output function.
+    static constexpr uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+        return x ^ (x >> 31);
+    }
+
+    // Fisher-Yates shuffle of the 7 types, drawing one number per swap from the counter.
+    static constexpr Bag bag(uint64_t seed, uint64_t index) {
+        constexpr uint64_t gamma = 0x9e3779b97f4a7c15;
+        uint64_t counter = mix(seed * gamma) + index * Tetrimino::num_tetriminoes * gamma;
+        Bag bag = Tetrimino::all_types;
+        for (int i = bag.size() - 1; i > 0; --i) {
+            std::swap(bag[i], bag[mix(counter += gamma) % (i + 1)]);
+        }
+        return bag;
+    }
+
+    // Piece n of the sequence, counting from 0.
+    static constexpr Tetrimino::type_t piece(uint64_t seed, uint64_t n) {
+        return bag(seed, n / Tetrimino::num_tetriminoes)[n % Tetrimino::num_tetriminoes];
+    }
+};
+
+// Features of a stack commonly weighed by evaluation functions. Heights count from the floor, and
+// walls count as occupied.
+struct BoardFeatures {
+    int aggregate_height; // sum of the column heights
+    int bumpiness;        // sum of the height differences between adjacent columns
+    int holes;            // empty cells below the top of their column
+    int wells;            // sum over the columns of how far both neighbours rise above them
+    int row_transitions;  // changes between empty and occupied cells along the non-empty rows
+
+    constexpr BoardFeatures operator+(const BoardFeatures &f) const {
+        return {aggregate_height + f.aggregate_height, bumpiness + f.bumpiness, holes + f.holes,
+                wells + f.wells, row_transitions + f.row_transitions};
+    }
+
+    constexpr BoardFeatures operator-(const BoardFeatures &f) const {
+        return {aggregate_height - f.aggregate_height, bumpiness - f.bumpiness, holes - f.holes,
+                wells - f.wells, row_transitions - f.row_transitions};
+    }
+
+    constexpr bool operator==(const BoardFeatures &) const = default;
+};
+
+// The playfield keeps one occupancy bit per cell, packed in a 16-bit mask per row, so that
+// collision tests cost a few bitwise operations per tetrimino row and a full row is simply
+// equal to `full_row`. The colour of the settled cells is kept in a separate plane which is
+// only looked at when rendering. The top of each column is kept as well, so that most drops
+// are found without scanning the rows, along with the counts the BoardFeatures are made of and a
+// Zobrist hash of the occupancy.
+template <int W, int H> class Playfield {
+  public:
+    static constexpr int width = W;
+    static constexpr int height = H;
+    static constexpr uint16_t full_row = (1 << W) - 1;
+    static_assert(W + 2 * Tetrimino::size <= 32, "shifted rows must fit in 32 bits");
+
+    std::array<uint16_t, height> rows;
+    std::array<uint8_t, width * height> colors;
+    // Topmost occupied row of each column, `height` if the column is empty: the surface of the
+    // stack. Kept up to date by place() and clear_full_rows().
+    std::array<uint8_t, width> tops;
+    // Number of occupied cells, and of row transitions (see BoardFeatures), kept alike.
+    int num_cells;
+    int row_transitions;
+    // Xor of the keys of the occupied cells, kept alike, so that identical stacks reached in
+    // different ways are told apart from others in O(1).
+    uint64_t key;
+
+    // A random key per cell.
+    static constexpr std::array<uint64_t, width * height> cell_keys = [] {
+        std::array<uint64_t, width * height> keys{};
+        for (size_t i = 0; i < keys.size(); ++i) {
+            keys[i] = BagRandomizer::mix((i + 1) * 0x9e3779b97f4a7c15);
+        }
+        return keys;
+    }();
+
+    Playfield() { clear(); }
+
+    void clear() {
+        rows.fill(0);
+        colors.fill(0);
+        tops.fill(height);
+        num_cells = 0;
+        row_transitions = 0;
+        key = 0;
+    }
+
+    int column_height(int x) const { return height - tops[x]; }
+
+    // Replace the occupancy of row y, leaving the colours as they are.
+    void set_row(int y, uint16_t row) {
+        num_cells += std::popcount(row) - std::popcount(rows[y]);
+        row_transitions += transitions(row) - transitions(rows[y]);
+        key ^= row_key(y, row ^ rows[y]);
+        rows[y] = row;
+        update_tops();
+    }
+
+    BoardFeatures features() const { return features(tops, num_cells, row_transitions); }
+
+    // How the features would change if the block were locked where it is and the rows it
+    // completes cleared, without changing the playfield. Only the rows of the block are looked
+    // at, and the columns whose top cell would be cleared.
+    BoardFeatures lock_delta(const Tetrimino &block, int &num_cleared) const {
+        const auto &mask = block.mask();
+        auto new_tops = tops;
+        int new_cells = num_cells, new_transitions = row_transitions;
+        std::array<uint16_t, Tetrimino::size> new_rows{};
+        int cleared = 0; // bit iy for row block.pos.y + iy
+        num_cleared = 0;
+        for (int iy = 0; iy < Tetrimino::size; ++iy) {
+            int y = block.pos.y + iy;
+            if (y < 0 || y >= height) continue;
+            uint16_t bits = (((uint32_t)mask[iy] << (block.pos.x + Tetrimino::size)) >>
+                             Tetrimino::size) &
+                            full_row;
+            new_rows[iy] = rows[y] | bits;
+            new_cells += std::popcount((uint16_t)(bits & ~rows[y]));
+            new_transitions += transitions(new_rows[iy]) - transitions(rows[y]);
+            for (uint16_t b = bits; b; b &= b - 1) {
+                int x = std::countr_zero(b);
+                new_tops[x] = std::min<int>(new_tops[x], y);
+            }
+            if (new_rows[iy] == full_row) {
+                cleared |= 1 << iy;
+                num_cleared++;
+            }
+        }
+
+        if (num_cleared > 0) {
+            // Full rows are all transitions-free. A cell moves down by the number of cleared
+            // rows below it; a column whose top cell is cleared gets the next cell down.
+            new_cells -= num_cleared * width;
+            auto is_cleared = [&](int y) {
+                int iy = y - block.pos.y;
+                return 0 <= iy && iy < Tetrimino::size && ((cleared >> iy) & 1);
+            };
+            auto row_after = [&](int y) {
+                int iy = y - block.pos.y;
+                return (0 <= iy && iy < Tetrimino::size) ? new_rows[iy] : rows[y];
+            };
+            for (int x = 0; x < width; ++x) {
+                int y = new_tops[x];
+                while (y < height && (is_cleared(y) || !((row_after(y) >> x) & 1))) y++;
+                int iy = y - block.pos.y;
+                if (y < height && iy + 1 < Tetrimino::size) {
+                    y += std::popcount((unsigned)cleared >> std::max(iy + 1, 0));
+                }
+                new_tops[x] = y;
+            }
+        }
+        return features(new_tops, new_cells, new_transitions) - features();
+    }
+
+    // The key the playfield would have if the block were locked where it is and the rows it
+    // completes cleared, and the number of those rows, without changing the playfield. Without
+    // clears, only the cells of the block are looked at; with clears, the rows which move down.
+    uint64_t lock_key(const Tetrimino &block, int &num_cleared) const {
+        const auto &mask = block.mask();
+        uint64_t k = key;
+        std::array<uint16_t, Tetrimino::size> new_rows{};
+        num_cleared = 0;
+        for (int iy = 0; iy < Tetrimino::size; ++iy) {
+            int y = block.pos.y + iy;
+            if (y < 0 || y >= height) continue;
+            uint16_t bits = (((uint32_t)mask[iy] << (block.pos.x + Tetrimino::size)) >>
+                             Tetrimino::size) &
+                            full_row;
+            new_rows[iy] = rows[y] | bits;
+            k ^= row_key(y, bits & ~rows[y]);
+            num_cleared += new_rows[iy] == full_row;
+        }
+        if (num_cleared == 0) return k;
+
+        auto row_after = [&](int y) {
+            int iy = y - block.pos.y;
+            return (0 <= iy && iy < Tetrimino::size) ? new_rows[iy] : rows[y];
+        };
+        int top = std::min<int>(*std::min_element(begin(tops), end(tops)), block.pos.y);
+        for (int y = height - 1, z = height; y >= std::max(top, 0); --y) {
+            uint16_t row = row_after(y);
+            if (row == full_row) {
+                k ^= row_key(y, full_row);
+            } else if (--z != y) {
+                k ^= row_key(y, row) ^ row_key(z, row);
+            }
+        }
+        return k;
+    }
+
+    // The key computed from the rows, for checking the one kept up to date.
+    uint64_t compute_key() const {
+        uint64_t k = 0;
+        for (int y = 0; y < height; ++y) k ^= row_key(y, rows[y]);
+        return k;
+    }
+
+    // Tile at p, with the same values as an Image: ' ' if empty, the tetrimino type otherwise.
+    int operator[](Point p) const {
+        int c = colors[p.x + p.y * width];
+        return c ? Tetrimino::I + c - 1 : ' ';
+    }
+
+    bool occupied(Point p) const {
+        if (p.x < 0 || p.x >= width || p.y < 0 || p.y >= height) return true;
+        return (rows[p.y] >> p.x) & 1;
+    }
+
+    // Whether a row mask, shifted right by x, overlaps the walls or row y.
+    bool collides(uint16_t mask, int x, int y) const {
+        if (x < -Tetrimino::size || x >= width) return true;
+        return ((uint32_t)mask << (x + Tetrimino::size)) & blocked(y);
+    }
+
+    bool can_place(const Tetrimino &block, Point p) const {
+        if (p.x < -Tetrimino::size || p.x >= width) return false;
+        const auto &mask = block.mask();
+        for (int iy = 0; iy < Tetrimino::size; ++iy) {
+            if (mask[iy] == 0) continue;
+            int y = p.y + iy;
+            if (y < 0 || y >= height) return false;
+            if (((uint32_t)mask[iy] << (p.x + Tetrimino::size)) & blocked(y)) return false;
+        }
+        return true;
+    }
+
+    // Settle the block at its current position.
+    void place(const Tetrimino &block) {
+        const auto &mask = block.mask();
+        for (int iy = 0; iy < Tetrimino::size; ++iy) {
+            int y = block.pos.y + iy;
+            if (mask[iy] == 0 || y < 0 || y >= height) continue;
+            uint16_t old_row = rows[y];
+            for (int ix = 0; ix < Tetrimino::size; ++ix) {
+                int x = block.pos.x + ix;
+                if (!((mask[iy] >> ix) & 1) || x < 0 || x >= width) continue;
+                rows[y] |= 1 << x;
+                colors[x + y * width] = block.type - Tetrimino::I + 1;
+                tops[x] = std::min<int>(tops[x], y);
+            }
+            num_cells += std::popcount((uint16_t)(rows[y] & ~old_row));
+            row_transitions += transitions(rows[y]) - transitions(old_row);
+            key ^= row_key(y, rows[y] & ~old_row);
+        }
+    }
+
+    // Remove the full rows, shifting the ones above down. Returns the number of rows removed.
+    int clear_full_rows() {
+        int z = height;
+        for (int y = height - 1; y >= 0; --y) {
+            if (rows[y] == full_row) {
+                key ^= row_key(y, full_row);
+                continue;
+            }
+            if (--z != y) {
+                key ^= row_key(y, rows[y]) ^ row_key(z, rows[y]);
+                rows[z] = rows[y];
+                std::copy_n(begin(colors) + y * width, width, begin(colors) + z * width);
+            }
+        }
+        int num_cleared = z;
+        std::fill_n(begin(rows), num_cleared, 0);
+        std::fill_n(begin(colors), num_cleared * width, 0);
+        if (num_cleared > 0) update_tops();
+        num_cells -= num_cleared * width; // full rows have no transitions
+        return num_cleared;
+    }
+
+    // Lowest row the block can fall to from its current position. When every column of the block
+    // is above the surface, it lands where its lowest cell in some column meets the top of that
+    // column; under overhangs, the rows are tried one by one.
+    int drop(const Tetrimino &block) const {
+        if (block.pos.y + block.bounds().top < 0) return scan_drop(block);
+        const auto &bottoms = block.bottoms();
+        int y = height;
+        for (int ix = 0; ix < Tetrimino::size; ++ix) {
+            if (bottoms[ix] < 0) continue;
+            int x = block.pos.x + ix;
+            if (x < 0 || x >= width || block.pos.y + bottoms[ix] >= tops[x]) {
+                return scan_drop(block);
+            }
+            y = std::min(y, tops[x] - 1 - bottoms[ix]);
+        }
+        return y;
+    }
+
+    int scan_drop(const Tetrimino &block) const {
+        int y = block.pos.y, oky = y;
+        for (; can_place(block, {block.pos.x, y}); oky = y++)
+            ;
+        return oky;
+    }
+
+    // FNV-1a hash of the occupancy and colour of all cells.
+    uint64_t hash() const {
+        uint64_t h = 0xcbf29ce484222325;
+        auto add = [&](uint64_t v) { h = (h ^ v) * 0x100000001b3; };
+        for (auto r : rows) add(r);
+        for (auto c : colors) add(c);
+        return h;
+    }
+
+    template <class I>
+    bool paste(I &image, Point p, int xscale = 1, int crop_top = 0) const {
+        for (int iy = crop_top; iy < height; iy++) {
+            for (int ix = 0; ix < width * xscale; ix++) {
+                auto o = p + Point{ix, iy - crop_top};
+                bool inside = (0 <= o.x) && (o.x < I::width) && (0 <= o.y) && (o.y < I::height);
+                if (inside) image[o] = (*this)[{ix / xscale, iy}];
+            }
+        }
+        return true;
+    }
+
+  private:
+    // Xor of the keys of the cells of row y set in `bits`.
+    static uint64_t row_key(int y, uint16_t bits) {
+        uint64_t k = 0;
+        for (; bits; bits &= bits - 1) k ^= cell_keys[y * width + std::countr_zero(bits)];
+        return k;
+    }
+
+    // Changes between empty and occupied along a row between the walls, 0 for an empty row.
+    static int transitions(uint16_t row) {
+        if (row == 0) return 0;
+        uint32_t walled = (uint32_t)row << 1 | 1 | 1u << (width + 1);
+        return std::popcount((walled ^ (walled >> 1)) & ((1u << (width + 1)) - 1));
+    }
+
+    static BoardFeatures features(const std::array<uint8_t, width> &tops, int num_cells,
+                                  int row_transitions) {
+        BoardFeatures f{0, 0, 0, 0, row_transitions};
+        for (int x = 0; x < width; ++x) {
+            int h = height - tops[x];
+            int left = (x > 0) ? height - tops[x - 1] : height;
+            int right = (x + 1 < width) ? height - tops[x + 1] : height;
+            f.aggregate_height += h;
+            if (x > 0) f.bumpiness += std::abs(h - left);
+            f.wells += std::max(std::min(left, right) - h, 0);
+        }
+        f.holes = f.aggregate_height - num_cells;
+        return f;
+    }
+
+    // Find the top of every column, going down the rows until all are found.
+    void update_tops() {
+        tops.fill(height);
+        uint16_t found = 0;
+        for (int y = 0; y < height && found != full_row; ++y) {
+            for (uint16_t fresh = rows[y] & ~found; fresh; fresh &= fresh - 1) {
+                tops[std::countr_zero(fresh)] = y;
+            }
+            found |= rows[y];
+        }
+    }
+
+    // Row y as seen by a mask shifted left by Tetrimino::size, with the walls marked as occupied.
+    uint32_t blocked(int y) const {
+        return ~((uint32_t)full_row << Tetrimino::size) | ((uint32_t)rows[y] << Tetrimino::size);
+    }
 };
 
 // [type (other or I)][direction (L or R)][base rotation][kick number]
-Point wall_kicks[2][2][4][5] = {
+inline constexpr Point wall_kicks[2][2][4][5] = {
     // J, L, T, S, Z
     {
         {{{0, 0}, {1, 0}, {1, -1}, {0, 2}, {1, 2}},      // 0>>3
@@ -222,7 +658,7 @@ Point wall_kicks[2][2][4][5] = {
 //   "C D "
 //   "    "
 
-Point tspin_corners[4][4] = {
+inline constexpr Point tspin_corners[4][4] = {
     // A B C D
     {{0, 0}, {2, 0}, {0, 2}, {2, 2}},
     {{0, 2}, {2, 2}, {0, 0}, {2, 0}},
@@ -232,17 +668,140 @@ Point tspin_corners[4][4] = {
 
 static constexpr ssize_t never = std::numeric_limits<ssize_t>::max() / 2;
 
-class Tetris {
-  public:
+// A scoring lock. Front ends turn it into text only when they display it.
+struct ScoreEvent {
+    enum Kind : uint8_t {
+        SINGLE,
+        DOUBLE,
+        TRIPLE,
+        TETRIS,
+        MINI_TSPIN,
+        MINI_TSPIN_SINGLE,
+        MINI_TSPIN_DOUBLE,
+        TSPIN,
+        TSPIN_SINGLE,
+        TSPIN_DOUBLE,
+        TSPIN_TRIPLE,
+    } kind;
+    uint8_t lines;
+    bool back_to_back;
+    int points;
+    ssize_t frame;
+
+    const char *name() const {
+        static constexpr const char *names[] = {"Single",
+                                                "Double",
+                                                "Triple",
+                                                "Tetris",
+                                                "Mini T-Spin",
+                                                "Mini T-Spin Single",
+                                                "Mini T-Spin Double",
+                                                "T-Spin",
+                                                "T-Spin Single",
+                                                "T-Spin Double",
+                                                "T-Spin Triple"};
+        return names[kind];
+    }
+
+    std::string text() const {
+        return std::string{name()} + (back_to_back ? " B2B " : " ") + std::to_string(points);
+    }
+};
+
+// Everything that determines how a game goes on: the matrix, the pieces, the bag, the timers and
+// the score. It is trivially copyable and a few hundred bytes large, so that games can be cloned
+// or rolled back with a flat copy (see Tetris::save_state).
+struct TetrisState {
     static constexpr int matrix_width = 10;
     static constexpr int matrix_height = 40;
     static constexpr int skyline = 20;
+    static constexpr int max_preview = 7;
+    static constexpr int max_score_events = 8;
 
     enum class GameState { WELCOME, GAME_OVER, PLAY };
-    enum class MoveType { TSPIN, MINI_TSPIN, NORMAL };
+    enum class MoveType : uint8_t { TSPIN, MINI_TSPIN, NORMAL };
+
+    using Matrix = Playfield<matrix_width, matrix_height>;
+
+    Matrix matrix;
+    Tetrimino block;
+    Tetrimino ghost_block;
+    Tetrimino held_block;
+    // Upcoming pieces, next first, in a ring starting at queue_head. Taking a piece refills its
+    // slot with the piece max_preview places further down the sequence.
+    std::array<Tetrimino::type_t, max_preview> queue;
+    int queue_head;
+    uint64_t num_sampled; // pieces drawn from the randomizer so far
+    int tally;
+    int num_lines_cleared;
+    int num_pieces;
+    int level;
+    int start_level; // the level goes up every 10 lines from there
+    bool can_hold;
+    int lowest_y;
+    int scheduled_drop_is_soft;
+    MoveType last_move;
+    int back_to_back;
+    // The last scoring events, in a ring indexed by num_score_events modulo its size.
+    std::array<ScoreEvent, max_score_events> score_events;
+    unsigned int num_score_events;
+    unsigned int next_game_seed;
+    unsigned int game_seed;
+    GameState game_state = GameState::WELCOME;
+    struct {
+        bool left : 1;
+        bool right : 1;
+    } controller_state{};
+    struct {
+        bool left : 1;
+        bool right : 1;
+        bool down : 1;
+    } command_state{};
+
+    // times in us
+    ssize_t game_time;
+    ssize_t lock_time;
+    ssize_t fall_time;
+    ssize_t repeat_translate_time;
+
+    int num_moves_left;
+
+    // Fall events are at most one frame apart; faster gravity moves the block by several rows
+    // at once.
+    ssize_t normal_fall_period;
+    ssize_t short_fall_period;
+    int normal_fall_rows;
+    int short_fall_rows;
+    // Rows per frame, or 0 to follow the level.
+    double gravity = 0;
+};
+
+class Tetris : protected TetrisState {
+  public:
+    using TetrisState::matrix_height;
+    using TetrisState::matrix_width;
+    using TetrisState::max_preview;
+    using TetrisState::max_score_events;
+    using TetrisState::skyline;
+
+    static constexpr int max_level = 15;
+
+    using TetrisState::GameState;
+    using TetrisState::Matrix;
+    using TetrisState::MoveType;
+
+    using State = TetrisState;
+    static_assert(std::is_trivially_copyable_v<State>);
+
+    // Where blocks enter the matrix, in their initial rotation.
+    static constexpr Point spawn_position{(matrix_width - Tetrimino::size) / 2,
+                                          matrix_height - skyline - 2};
+
+    // Duration of a frame of the front ends, in us.
+    static constexpr ssize_t frame_period = 16'666;
 
     struct Input {
-        enum class Value {
+        enum class Value : uint8_t {
             rotate_left,
             rotate_right,
             move_left,
@@ -253,60 +812,158 @@ class Tetris {
             quit
         } value;
         enum class State { pressed, released } state;
-        ssize_t frame;
+        ssize_t time; // us of game time, like the events of the engine
     };
 
-    Tetris(unsigned int seed = 0)
-        : rng{seed}, alive{true}, game_state{GameState::WELCOME}, controller_state{}, command_state{} {}
+    // The preview shows the pieces of the first game from the welcome screen on.
+    Tetris(unsigned int seed = 0) : alive{true} {
+        next_game_seed = game_seed = seed;
+        fill_queue();
+    }
+
+    // Copy of the state of the game. Restoring it with load_state() brings the game back to
+    // exactly the same point, piece sequence included.
+    State save_state() const { return *this; }
+    void load_state(const State &state) { static_cast<State &>(*this) = state; }
 
     void set_level(int level) {
-        level = level;
-        normal_fall_period = (ssize_t)(1e6 * pow(0.8 - (level - 1) * 0.0007, level - 1));
-        short_fall_period = normal_fall_period / 20;
+        this->level = level;
+        ssize_t row_period = (gravity > 0)
+                                 ? (ssize_t)(frame_period / gravity)
+                                 : (ssize_t)(1e6 * pow(0.8 - (level - 1) * 0.0007, level - 1));
+        set_fall_period(normal_fall_period, normal_fall_rows, row_period);
+        set_fall_period(short_fall_period, short_fall_rows, row_period / 20);
     }
 
+    // Fix the gravity to `rows_per_frame`, whatever the level. It takes effect when the level is
+    // next set: at the start of a game, or at the next level up of the current one. 20G and above
+    // drop the block straight onto the surface. 0 goes back to the gravity of the level.
+    void set_gravity(double rows_per_frame) { gravity = rows_per_frame; }
+
     ssize_t current_frame() const { return (game_time + frame_period - 1) / frame_period; }
 
+    GameState get_game_state() const { return game_state; }
+    ssize_t get_game_time() const { return game_time; }
+    int get_level() const { return level; }
+    int get_score() const { return tally; }
+    int get_num_lines_cleared() const { return num_lines_cleared; }
+    int get_num_pieces() const { return num_pieces; }
+    unsigned int get_game_seed() const { return game_seed; }
+
+    // Scoring events of the game still in the ring, and the k-th most recent of them.
+    int get_num_score_events() const { return std::min<int>(num_score_events, max_score_events); }
+
+    const ScoreEvent &get_score_event(int k) const {
+        assert(0 <= k && k < get_num_score_events());
+        return score_events[(num_score_events - 1 - k) % max_score_events];
+    }
+
+    // The k-th upcoming piece, 0 being the next block. Does not change the game.
+    Tetrimino::type_t preview(int k) const {
+        assert(0 <= k && k < max_preview);
+        return queue[(queue_head + k) % max_preview];
+    }
+
+    // Number of upcoming pieces shown to the player, from 1 to max_preview.
+    int get_preview_depth() const { return preview_depth; }
+
+    void set_preview_depth(int depth) {
+        assert(1 <= depth && depth <= max_preview);
+        preview_depth = depth;
+    }
+    uint64_t get_board_hash() const { return matrix.hash(); }
+
+    // Zobrist hash of the position as a search sees it: the matrix, the block in play, the held
+    // block and whether it can be swapped, and the previewed pieces. The matrix keeps its part up
+    // to date (see Playfield::key), and the keys of the pieces are folded in on each call.
+    uint64_t get_position_hash() const {
+        uint64_t h = matrix.key ^ piece_key(0, block.type, block.rot, block.pos) ^
+                     piece_key(1, held_block.type) ^ (can_hold ? can_hold_key : 0);
+        for (int k = 0; k < preview_depth; ++k) h ^= piece_key(2 + k, preview(k));
+        return h;
+    }
+
+    // A random key per slot of a position and piece in it: 0 for the block in play, 1 for the
+    // held block and 2 on for the previewed pieces.
+    static uint64_t piece_key(int slot, Tetrimino::type_t type, int rot = 0, Point pos = {0, 0}) {
+        // The top bit keeps them apart from the keys of the cells.
+        uint64_t fields = 1ull << 63 | (uint64_t)slot << 40 | (uint64_t)type << 24 | rot << 16 |
+                          (uint8_t)pos.x << 8 | (uint8_t)pos.y;
+        return BagRandomizer::mix(fields * 0x9e3779b97f4a7c15);
+    }
+
+    const Matrix &get_matrix() const { return matrix; }
+    const Tetrimino &get_block() const { return block; }
+    const Tetrimino &get_held_block() const { return held_block; }
+    bool get_can_hold() const { return can_hold; }
+    MoveType get_last_move() const { return last_move; }
+    // Rows a tap of soft drop falls at the current gravity, unless the stack stops the block.
+    int get_soft_drop_rows() const { return short_fall_rows; }
+
+    // Features of the stack for evaluation functions, kept up to date as blocks lock.
+    BoardFeatures get_board_features() const { return matrix.features(); }
+
+    // How locking the block where it is would change the features (see Playfield::lock_delta).
+    BoardFeatures lock_delta(const Tetrimino &block, int &num_cleared) const {
+        return matrix.lock_delta(block, num_cleared);
+    }
+
+    // Number of falls, locks, repeated translations and inputs run by the last call to tic().
+    int get_num_tic_events() const { return num_tic_events; }
+
+    // Time of the next fall, lock or repeated translation, if any. Inputs are not included.
+    ssize_t get_next_event_time() const {
+        if (game_state != GameState::PLAY) return never;
+        return std::min({repeat_translate_time, lock_time, fall_time});
+    }
+
     void new_game(int level) {
         assert(1 <= level && level <= max_level);
+        // Each game draws its pieces from its own seed, so that it can be replayed on its own.
+        game_seed = next_game_seed++;
+        fill_queue();
+        controller_state = {};
+        command_state = {};
         game_time = 0;
         tally = 0;
         num_lines_cleared = 0;
+        num_pieces = 0;
+        num_score_events = 0;
         scheduled_drop_is_soft = false;
 
         matrix.clear();
 
-        sample_next_block();
-        block = next_block;
+        block = take_next_block();
         held_block.type = Tetrimino::none;
-        sample_next_block();
 
+        start_level = level;
         set_level(level);
 
         can_hold = true;
         repeat_translate_time = never;
 
         respawn(0, block);
+        fall_time = normal_fall_period;
 
         game_state = GameState::PLAY;
     }
 
     void lock(ssize_t time) {
-        block.paste(matrix, block.pos);
+        matrix.place(block);
+        num_pieces++;
 
         if (block.pos.y < matrix_height - skyline) {
             game_state = GameState::GAME_OVER;
         } else {
-            clear_rows();
+            clear_rows(time);
             can_hold = true;
-            block = next_block;
-            sample_next_block();
+            block = take_next_block();
             respawn(time, block);
         }
     }
 
     void respawn(ssize_t time, Tetrimino &block) {
-        block.pos = {.x = (matrix_width - Tetrimino::size) / 2, .y = matrix_height - skyline - 2};
+        block.pos = spawn_position;
         fall_time = never;
         lock_time = never;
         scheduled_drop_is_soft = false;
@@ -316,31 +973,258 @@ class Tetris {
         back_to_back = 0;
     }
 
-    bool can_fall(const Tetrimino &block) const { return block.can_paste(matrix, block.pos + shift_down); }
-    bool can_fit(const Tetrimino &block) const { return block.can_paste(matrix, block.pos); }
-    int drop(const Tetrimino &block) const {
-        int y = block.pos.y, oky = y;
-        for (; block.can_paste(matrix, {block.pos.x, y}); oky = y++)
-            ;
-        return oky;
+    // The first pieces of the sequence of game_seed.
+    void fill_queue() {
+        num_sampled = 0;
+        queue_head = 0;
+        for (auto &type : queue) {
+            type = BagRandomizer::piece(game_seed, num_sampled++);
+        }
+    }
+
+    // A row every `row_period` us, as fall events at most one frame apart. From 20 rows per event
+    // on, each event drops the block onto the surface, still once per frame.
+    static void set_fall_period(ssize_t &period, int &rows, ssize_t row_period) {
+        row_period = std::max<ssize_t>(row_period, 1);
+        rows = (int)std::max<ssize_t>(frame_period / row_period, 1);
+        period = rows * row_period;
+        if (rows >= skyline) rows = matrix_height;
+    }
+
+    bool can_fall(const Tetrimino &block) const { return matrix.can_place(block, block.pos + shift_down); }
+    bool can_fit(const Tetrimino &block) const { return matrix.can_place(block, block.pos); }
+    int drop(const Tetrimino &block) const { return matrix.drop(block); }
+
+    // Rotate the block by dr quarter turns clockwise, trying the SRS wall kicks in turn. On
+    // success, `type` tells whether the rotation makes a T-Spin or Mini T-Spin. The matrix may be
+    // anything with Matrix's can_place() and occupied().
+    template <class M>
+    static bool try_rotate(const M &matrix, Tetrimino &block, int dr, MoveType &type) {
+        const auto &kicks = wall_kicks[block.type == Tetrimino::I][dr > 0][block.rot];
+        Tetrimino rotated = block;
+        rotated.rotate((block.rot + dr) & 3);
+        for (size_t k = 0; k < sizeof(kicks) / sizeof(kicks[0]); ++k) {
+            if (!matrix.can_place(rotated, rotated.pos + kicks[k])) continue;
+            rotated.pos += kicks[k];
+            // Check for T-Spin and Mini T-Spin.
+            type = MoveType::NORMAL;
+            if (rotated.type == Tetrimino::T) {
+                const auto &pts = tspin_corners[rotated.rot];
+                auto A = matrix.occupied(rotated.pos + pts[0]);
+                auto B = matrix.occupied(rotated.pos + pts[1]);
+                auto C = matrix.occupied(rotated.pos + pts[2]);
+                auto D = matrix.occupied(rotated.pos + pts[3]);
+                if (k == 4) {
+                    type = MoveType::TSPIN;
+                } else if ((A && B) && (C || D)) {
+                    type = MoveType::TSPIN;
+                } else if ((A || B) && (C && D)) {
+                    type = MoveType::MINI_TSPIN;
+                }
+            }
+            block = rotated;
+            return true;
+        }
+        return false;
     }
 
-    void sample_next_block() {
-        if (queue.empty()) {
-            auto bag = Tetrimino::all_types;
-            std::shuffle(begin(bag), end(bag), rng);
-            for (auto i : bag) {
-                queue.push(i);
+    // A final resting place of a block, as it would be locked.
+    struct Placement {
+        Point pos;
+        int rot;
+        MoveType type;   // as scored when locking
+        int path_length; // number of inputs to get there, including the final hard drop
+        int node;
+    };
+
+    // Breadth-first search of all the placements a block can reach with the engine's own moves:
+    // translations, SRS rotations (with T-Spin detection) and falls. States are (x, y, rotation,
+    // last move), each visited at most once. Timing (gravity, lock delay, extended locking) is
+    // not taken into account. The buffers are kept from one search to the next, so that searching
+    // does not allocate once warmed up.
+    //
+    // Above the stack, with room for the kicks, moves do not depend on the height of the block,
+    // so translations and rotations there are only expanded from the highest state of each
+    // (x, rotation, last move); the states below it are only used to fall further.
+    class PlacementSearch {
+      public:
+        std::vector<Placement> placements;
+
+        // A soft drop falls `soft_drop_rows` at once, stopping on the stack, as a tap of the key
+        // does at the gravity of the game (see get_soft_drop_rows).
+        void run(const Matrix &matrix, const Tetrimino &block, MoveType last_move,
+                 int soft_drop_rows = 1) {
+            assert(soft_drop_rows >= 1);
+            placements.clear();
+            visited.fill(0);
+            landed.fill(0);
+            expanded.fill(0);
+            num_nodes = 0;
+            int top = *std::min_element(begin(matrix.tops), end(matrix.tops));
+            Fits fits{matrix, block};
+            if (!fits.can_place(block, block.pos)) return;
+            visit(block.pos, block.rot, last_move, -1, Input::Value::hard_drop);
+            for (int i = 0; i < num_nodes; ++i) {
+                const Node n = nodes[i];
+                Tetrimino b = block;
+                b.pos = {n.x, n.y};
+                b.rotate(n.rot);
+
+                int y = fits.drop(b);
+                if (mark(landed, index({b.pos.x, y}, n.rot, n.type))) {
+                    placements.push_back({{b.pos.x, y}, n.rot, n.type, n.depth + 1, i});
+                }
+
+                constexpr int max_kick_down = 2;
+                bool in_air = b.pos.y + b.bounds().bottom + max_kick_down < top;
+                if (!in_air || mark(expanded, ((int)n.type * 4 + n.rot) * xs + n.x + pad)) {
+                    expand(fits, b, n, i);
+                }
+                if (y > b.pos.y) {
+                    visit({b.pos.x, std::min(b.pos.y + soft_drop_rows, y)}, n.rot, n.type, i,
+                          Input::Value::soft_drop);
+                }
+            }
+        }
+
+        // Shortest sequence of inputs reaching the placement. Here soft_drop stands for a press
+        // and release of the key, falling as run() was told, and the sequence always ends with a
+        // hard drop.
+        void path(const Placement &placement, std::vector<Input::Value> &inputs) const {
+            inputs.clear();
+            inputs.push_back(Input::Value::hard_drop);
+            for (int i = placement.node; nodes[i].parent >= 0; i = nodes[i].parent) {
+                inputs.push_back(nodes[i].move);
+            }
+            std::reverse(begin(inputs), end(inputs));
+        }
+
+      private:
+        // Block positions range over [-pad, width) x [-pad, height).
+        static constexpr int pad = Tetrimino::size - 1;
+        static constexpr int xs = matrix_width + pad;
+        static constexpr int ys = matrix_height + pad;
+        static constexpr int num_states = xs * ys * 4 * 3;
+        static_assert(ys < 64);
+
+        // Where one block fits, precomputed for every rotation and column as one bit per row, so
+        // that the search only tests bits.
+        struct Fits {
+            const Matrix &matrix;
+            std::array<std::array<uint64_t, xs>, 4> blocked; // bit y + pad: cannot be at (x, y)
+
+            Fits(const Matrix &matrix, const Tetrimino &block) : matrix{matrix} {
+                // Rows hit by each shifted row of the block.
+                std::array<std::array<uint64_t, xs>, 1 << Tetrimino::size> hits{};
+                Tetrimino b = block;
+                for (int rot = 0; rot < 4; ++rot) {
+                    b.rotate(rot);
+                    for (auto m : b.mask()) {
+                        if (m == 0 || hits[m][0]) continue;
+                        for (int x = -pad; x < matrix_width; ++x) {
+                            uint64_t h = 1; // non-zero marks the entry as computed
+                            for (int y = 0; y < matrix_height; ++y) {
+                                h |= (uint64_t)matrix.collides(m, x, y) << (y + pad);
+                            }
+                            hits[m][x + pad] = h;
+                        }
+                    }
+                    for (int x = -pad; x < matrix_width; ++x) {
+                        uint64_t c = ~(uint64_t)0 << ys;
+                        for (int iy = 0; iy < Tetrimino::size; ++iy) {
+                            auto m = b.mask()[iy];
+                            if (m == 0) continue;
+                            c |= ((hits[m][x + pad] & ~(uint64_t)1) >> iy) |
+                                 (((uint64_t)1 << (pad - iy)) - 1) | (~(uint64_t)0 << (ys - iy));
+                        }
+                        blocked[rot][x + pad] = c;
+                    }
+                }
+            }
+
+            bool can_place(const Tetrimino &b, Point p) const {
+                if (p.x < -pad || p.x >= matrix_width || p.y < -pad || p.y >= matrix_height) {
+                    return false;
+                }
+                return !((blocked[b.rot][p.x + pad] >> (p.y + pad)) & 1);
             }
+
+            bool occupied(Point p) const { return matrix.occupied(p); }
+
+            // Lowest row the block can fall to, assuming it fits where it is.
+            int drop(const Tetrimino &b) const {
+                uint64_t below = blocked[b.rot][b.pos.x + pad] >> (b.pos.y + pad + 1);
+                return b.pos.y + std::countr_zero(below);
+            }
+        };
+
+        struct Node {
+            int8_t x, y, rot;
+            MoveType type;
+            Input::Value move;
+            int16_t parent;
+            uint16_t depth;
+        };
+
+        std::array<Node, num_states> nodes;
+        int num_nodes;
+        std::array<uint64_t, (num_states + 63) / 64> visited;
+        std::array<uint64_t, (num_states + 63) / 64> landed;
+
+        static int index(Point p, int rot, MoveType type) {
+            return (((int)type * 4 + rot) * ys + p.y + pad) * xs + p.x + pad;
         }
-        next_block = Tetrimino(queue.front());
-        queue.pop();
+
+        std::array<uint64_t, (xs * 4 * 3 + 63) / 64> expanded;
+
+        template <size_t N> static bool mark(std::array<uint64_t, N> &set, int i) {
+            uint64_t bit = (uint64_t)1 << (i & 63);
+            if (set[i >> 6] & bit) return false;
+            set[i >> 6] |= bit;
+            return true;
+        }
+
+        // Visit the states reached by translating or rotating the block of node i.
+        void expand(const Fits &fits, const Tetrimino &b, const Node &n, int i) {
+            for (auto [shift, move] : {std::pair{shift_left, Input::Value::move_left},
+                                       std::pair{shift_right, Input::Value::move_right}}) {
+                if (fits.can_place(b, b.pos + shift)) {
+                    visit(b.pos + shift, n.rot, MoveType::NORMAL, i, move);
+                }
+            }
+            for (auto [dr, move] : {std::pair{-1, Input::Value::rotate_left},
+                                    std::pair{1, Input::Value::rotate_right}}) {
+                Tetrimino r = b;
+                MoveType type;
+                if (try_rotate(fits, r, dr, type)) visit(r.pos, r.rot, type, i, move);
+            }
+        }
+
+        void visit(Point p, int rot, MoveType type, int parent, Input::Value move) {
+            if (!mark(visited, index(p, rot, type))) return;
+            int depth = (parent >= 0) ? nodes[parent].depth + 1 : 0;
+            nodes[num_nodes++] = {(int8_t)p.x, (int8_t)p.y,      (int8_t)rot,    type,
+                                  move,        (int16_t)parent, (uint16_t)depth};
+        }
+    };
+
+    // Find all the placements of the active block.
+    void find_placements(PlacementSearch &search) const {
+        search.run(matrix, block, last_move, short_fall_rows);
+    }
+
+    Tetrimino take_next_block() {
+        Tetrimino next(queue[queue_head]);
+        queue[queue_head] = BagRandomizer::piece(game_seed, num_sampled++);
+        queue_head = (queue_head + 1) % max_preview;
+        return next;
     }
 
     bool tic(ssize_t time, std::queue<Input> &inputs) {
         using IN = Tetris::Input;
 
         game_time += time;
+        num_tic_events = 0;
 
         // Other screens.
         if (game_state == GameState::WELCOME || game_state == GameState::GAME_OVER) {
@@ -370,7 +1254,7 @@ class Tetris {
         while (game_state != GameState::GAME_OVER && alive) {
 
             // After a successful move, apply extended locking rules.
-            auto accept_move = [&, this](MoveType type, int now) {
+            auto accept_move = [&, this](MoveType type, ssize_t now) {
                 if (lock_time < never && num_moves_left > 0) {
                     num_moves_left--;
                     lock_time = std::max(lock_time, now + lock_period);
@@ -379,8 +1263,8 @@ class Tetris {
             };
 
             // Translation move.
-            auto translate = [&, this](int shift, int time) {
-                if (block.can_paste(matrix, block.pos + Point{shift, 0})) {
+            auto translate = [&, this](int shift, ssize_t time) {
+                if (matrix.can_place(block, block.pos + Point{shift, 0})) {
                     block.pos += {shift, 0};
                     accept_move(MoveType::NORMAL, time);
                 }
@@ -388,10 +1272,11 @@ class Tetris {
 
             while (true) {
 
-                ssize_t input_time = inputs.empty() ? never : inputs.front().frame * frame_period;
+                ssize_t input_time = inputs.empty() ? never : inputs.front().time;
                 ssize_t current_time =
                     std::min({repeat_translate_time, lock_time, fall_time, input_time});
                 if (current_time > game_time) goto done;
+                num_tic_events++;
 
                 // Repeat translate event
                 if (repeat_translate_time <= current_time) {
@@ -407,8 +1292,11 @@ class Tetris {
 
                 // Fall event
                 else if (fall_time <= current_time) {
-                    block.pos += shift_down;
-                    if (scheduled_drop_is_soft) tally++;
+                    int rows = scheduled_drop_is_soft ? short_fall_rows : normal_fall_rows;
+                    int y = block.pos.y + 1;
+                    if (rows > 1) y = std::min(block.pos.y + rows, drop(block));
+                    if (scheduled_drop_is_soft) tally += y - block.pos.y;
+                    block.pos.y = y;
                     if (command_state.down) {
                         scheduled_drop_is_soft = true;
                         fall_time += short_fall_period;
@@ -450,34 +1338,8 @@ class Tetris {
                     case IN::Value::rotate_right: {
                         if (input.state == IN::State::released) break;
                         int dr = (input.value == IN::Value::rotate_left) ? -1 : 1;
-                        const auto &kicks =
-                            wall_kicks[block.type == Tetrimino::I][dr > 0][block.rot];
-                        block.rotate((block.rot + dr) & 3);
-                        for (size_t k = 0; k < sizeof(kicks) / sizeof(kicks[0]); ++k) {
-                            if (block.can_paste(matrix, block.pos + kicks[k])) {
-                                block.pos += kicks[k];
-                                // Check for T-Spin and Mini T-Spin.
-                                MoveType type = MoveType::NORMAL;
-                                if (block.type == Tetrimino::T) {
-                                    const auto &pts = tspin_corners[block.rot];
-                                    auto A = matrix.occupied(block.pos + pts[0]);
-                                    auto B = matrix.occupied(block.pos + pts[1]);
-                                    auto C = matrix.occupied(block.pos + pts[2]);
-                                    auto D = matrix.occupied(block.pos + pts[3]);
-                                    if (k == 4) {
-                                        type = MoveType::TSPIN;
-                                    } else if ((A && B) && (C || D)) {
-                                        type = MoveType::TSPIN;
-                                    } else if ((A || B) && (C && D)) {
-                                        type = MoveType::MINI_TSPIN;
-                                    }
-                                }
-                                accept_move(type, input_time);
-                                goto accepted;
-                            }
-                        }
-                        block.rotate((block.rot - dr) & 3);
-                    accepted:
+                        MoveType type;
+                        if (try_rotate(matrix, block, dr, type)) accept_move(type, input_time);
                         break;
                     }
 
@@ -512,8 +1374,7 @@ class Tetris {
                                 std::swap(held_block, block);
                             } else {
                                 held_block = block;
-                                block = next_block;
-                                sample_next_block();
+                                block = take_next_block();
                             }
                             respawn(input_time, block);
                         }
@@ -549,81 +1410,38 @@ class Tetris {
         ghost_block = block;
         ghost_block.pos.y = drop(block);
         ghost_block.recolor(Tetrimino::G);
-        ghost_block.type = can_fit(ghost_block) ? Tetrimino::G : Tetrimino::none;
+        if (!can_fit(ghost_block)) ghost_block.type = Tetrimino::none;
 
         return alive;
     }
 
   protected:
-    Image<matrix_width, matrix_height> matrix;
-    Tetrimino block;
-    Tetrimino next_block;
-    Tetrimino ghost_block;
-    Tetrimino held_block;
-    std::queue<Tetrimino::type_t> queue;
     bool alive;
-    int tally;
-    int num_lines_cleared;
-    static constexpr int max_level = 15;
-    int level;
-    bool can_hold;
-    int lowest_y;
-    int scheduled_drop_is_soft;
-    MoveType last_move;
-    int back_to_back;
-    std::mt19937 rng;
-    GameState game_state;
-    struct {
-        bool left : 1;
-        bool right : 1;
-    } controller_state;
-    struct {
-        bool left : 1;
-        bool right : 1;
-        bool down : 1;
-    } command_state;
-
-    // times in us
-    ssize_t game_time;
-    ssize_t lock_time;
-    ssize_t fall_time;
-    ssize_t repeat_translate_time;
+    int preview_depth = 1;
+    int num_tic_events = 0;
 
     static constexpr int max_num_moves = 15;
-    int num_moves_left;
+    static constexpr uint64_t can_hold_key = 0x2c1b3c6d6a09e667;
 
-    ssize_t normal_fall_period;
-    ssize_t short_fall_period;
     static constexpr ssize_t lock_period = 500'000;
-    static constexpr ssize_t frame_period = 16'666;
     static constexpr ssize_t repeat_translate_period = 30'000;
     static constexpr ssize_t repeat_translate_grace_period = 500'000;
 
-    std::vector<std::string> messages;
-
-    void clear_rows() {
-        // Find which rows to keep
-        int num_kept = 0;
-        std::array<int, matrix_height> copy_to;
-        std::fill(begin(copy_to), end(copy_to), -1);
-        for (int y = matrix_height - 1; y >= 0; --y) {
-            const auto &row = matrix[y];
-            if (any_of(begin(row), end(row), [](char c) { return c == ' '; })) {
-                copy_to[y] = matrix_height - 1 - num_kept++;
-            }
-        }
+
+    void clear_rows(ssize_t time) {
+        int num_cleared = matrix.clear_full_rows();
+        assert(matrix.key == matrix.compute_key());
 
         // Update score
-        int num_cleared = matrix_height - num_kept;
         num_lines_cleared += num_cleared;
         int score = 0;
-        std::string msg;
+        ScoreEvent::Kind kind;
         int bb = back_to_back;
 
 #undef CASE
-#define CASE(N, M, S, B)                                                                           \
+#define CASE(N, K, S, B)                                                                           \
     case N:                                                                                        \
-        msg = M;                                                                                   \
+        kind = ScoreEvent::K;                                                                      \
         score = S;                                                                                 \
         bb B;                                                                                      \
         break;
@@ -631,52 +1449,43 @@ class Tetris {
         switch (last_move) {
         case MoveType::NORMAL:
             switch (num_cleared) {
-                CASE(1, "Single", 100, = 0);
-                CASE(2, "Double", 300, = 0);
-                CASE(3, "Triple", 500, = 0);
-                CASE(4, "Tetris", 800, += 1);
+                CASE(1, SINGLE, 100, = 0);
+                CASE(2, DOUBLE, 300, = 0);
+                CASE(3, TRIPLE, 500, = 0);
+                CASE(4, TETRIS, 800, += 1);
             }
             break;
         case MoveType::MINI_TSPIN:
             switch (num_cleared) {
-                CASE(0, "Mini T-Spin", 100, );
-                CASE(1, "Mini T-Spin Single", 200, += 1);
+                CASE(0, MINI_TSPIN, 100, );
+                CASE(1, MINI_TSPIN_SINGLE, 200, += 1);
+                CASE(2, MINI_TSPIN_DOUBLE, 400, += 1);
             default: assert(false);
             }
             break;
         case MoveType::TSPIN:
             switch (num_cleared) {
-                CASE(0, "T-Spin", 400, );
-                CASE(1, "T-Spin Single", 800, += 1);
-                CASE(2, "T-Spin Double", 1200, += 1);
-                CASE(3, "T-Spin Triple", 1600, += 1);
+                CASE(0, TSPIN, 400, );
+                CASE(1, TSPIN_SINGLE, 800, += 1);
+                CASE(2, TSPIN_DOUBLE, 1200, += 1);
+                CASE(3, TSPIN_TRIPLE, 1600, += 1);
             case 4: assert(false);
             }
             break;
         }
         score *= level;
-        if (bb > back_to_back && back_to_back >= 1) {
-            score += score / 2;
-            msg += " B2B";
-        }
+        bool b2b = bb > back_to_back && back_to_back >= 1;
+        if (b2b) score += score / 2;
         back_to_back = bb;
         if (score > 0) {
-            messages.push_back(msg + " " + std::to_string(score));
+            score_events[num_score_events++ % max_score_events] = {
+                kind, (uint8_t)num_cleared, b2b, score, (time + frame_period - 1) / frame_period};
             tally += score;
         }
 
-        set_level(std::min(1 + (num_lines_cleared / 10), max_level));
-
-        // Erase rows
-        for (int y = matrix_height - 1; y >= 0; --y) {
-            int z = copy_to[y];
-            if (z >= 0 && z != y) {
-                copy(begin(matrix[y]), end(matrix[y]), begin(matrix[z]));
-            }
-        }
-        for (int z = matrix_height - 1 - num_kept; z >= 0; --z) {
-            fill(begin(matrix[z]), end(matrix[z]), ' ');
-        }
+        set_level(std::min(start_level + (num_lines_cleared / 10), max_level));
+        // A game never falls below the level it started at.
+        assert(level >= start_level);
     }
 };
 